@@ -0,0 +1,680 @@
+/*****************************************************************************
+ * bench.c: decoding benchmark without VFW
+ *****************************************************************************
+ * Copyright (C) 2003-2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "decoder.h"
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+/* Normally defined by driverproc.c */
+x264vfw_mutex_t x264vfw_CS;
+
+static const struct
+{
+    const char *name;
+    int        csp;
+} bench_csp[] =
+{
+    { "I420", X264VFW_CSP_I420 },
+    { "YV12", X264VFW_CSP_YV12 },
+    { "YV16", X264VFW_CSP_YV16 },
+    { "YV24", X264VFW_CSP_YV24 },
+    { "NV12", X264VFW_CSP_NV12 },
+    { "YUYV", X264VFW_CSP_YUYV },
+    { "UYVY", X264VFW_CSP_UYVY },
+    { "BGR",  X264VFW_CSP_BGR  },
+    { "BGRA", X264VFW_CSP_BGRA },
+    { "P010", X264VFW_CSP_P010 },
+    { "P016", X264VFW_CSP_P016 },
+    { "v210", X264VFW_CSP_V210 },
+    { "Y410", X264VFW_CSP_Y410 },
+    { "Y416", X264VFW_CSP_Y416 }
+};
+
+/* Access unit of the input file */
+typedef struct
+{
+    uint8_t  *data;
+    uint32_t size;
+} bench_au_t;
+
+static uint8_t *read_file(const char *filename, int *size)
+{
+    FILE *f = fopen(filename, "rb");
+    uint8_t *buf = NULL;
+    int alloc = 0;
+    int len = 0;
+    size_t n;
+
+    if (!f)
+        return NULL;
+    do
+    {
+        if (len == alloc)
+        {
+            uint8_t *tmp;
+            alloc = alloc ? alloc * 2 : 1 << 20;
+            if (!(tmp = realloc(buf, alloc)))
+            {
+                free(buf);
+                fclose(f);
+                return NULL;
+            }
+            buf = tmp;
+        }
+        n = fread(buf + len, 1, alloc - len, f);
+        len += n;
+    } while (n > 0);
+    fclose(f);
+    *size = len;
+    return buf;
+}
+
+/* Offset of the next 00 00 01 start code at or after pos, or size */
+static int find_start_code(const uint8_t *buf, int size, int pos)
+{
+    for (; pos + 3 <= size; pos++)
+        if (buf[pos] == 0 && buf[pos + 1] == 0 && buf[pos + 2] == 1)
+            return pos;
+    return size;
+}
+
+/* Does the NAL unit start a new access unit once a VCL NAL unit was seen? */
+static int starts_access_unit(const uint8_t *nal, int nal_size)
+{
+    int type;
+
+    if (nal_size < 3)
+        return 0;
+    type = HEVC_NAL_TYPE(nal);
+    if (type < 32)
+        return (nal[2] & 0x80) != 0; /* first_slice_segment_in_pic_flag */
+    return type == HEVC_NAL_VPS || type == HEVC_NAL_SPS || type == HEVC_NAL_PPS ||
+           type == 35 /* AUD */ || type == 39 /* prefix SEI */;
+}
+
+/* Split the stream into access units, returns their count or -1 */
+static int split_access_units(uint8_t *buf, int size, int nal_length_size, bench_au_t **aus, x264vfw_hevc_sps_t *sps)
+{
+    int count = 0;
+    int alloc = 0;
+    int au_start = 0;
+    int vcl_seen = 0;
+    int sps_valid = 0;
+    int pos = nal_length_size ? 0 : find_start_code(buf, size, 0);
+
+    *aus = NULL;
+    while (pos < size)
+    {
+        int nal_pos, next;
+
+        if (nal_length_size)
+        {
+            uint32_t len;
+            if (pos + 4 > size)
+                break;
+            len = (uint32_t)buf[pos] << 24 | buf[pos + 1] << 16 | buf[pos + 2] << 8 | buf[pos + 3];
+            nal_pos = pos + 4;
+            if (len > (uint32_t)(size - nal_pos))
+                break;
+            next = nal_pos + len;
+        }
+        else
+        {
+            nal_pos = pos + 3;
+            next = find_start_code(buf, size, nal_pos);
+            /* The zero byte of a 4-byte start code belongs to the next NAL unit */
+            if (next < size && next > nal_pos && buf[next - 1] == 0)
+                next--;
+        }
+
+        if (vcl_seen && starts_access_unit(buf + nal_pos, next - nal_pos))
+        {
+            if (count == alloc)
+            {
+                bench_au_t *tmp;
+                alloc = alloc ? alloc * 2 : 1024;
+                if (!(tmp = realloc(*aus, alloc * sizeof(bench_au_t))))
+                    return -1;
+                *aus = tmp;
+            }
+            (*aus)[count].data = buf + au_start;
+            (*aus)[count].size = pos - au_start;
+            count++;
+            au_start = pos;
+            vcl_seen = 0;
+        }
+        if (next - nal_pos >= 2)
+        {
+            int type = HEVC_NAL_TYPE(buf + nal_pos);
+            if (type < 32)
+                vcl_seen = 1;
+            else if (type == HEVC_NAL_SPS && !sps_valid)
+                sps_valid = x264vfw_hevc_parse_sps(sps, buf + nal_pos, next - nal_pos) == 0;
+        }
+        pos = nal_length_size ? next : find_start_code(buf, size, next);
+    }
+
+    if (vcl_seen)
+    {
+        if (count == alloc)
+        {
+            bench_au_t *tmp;
+            if (!(tmp = realloc(*aus, (alloc + 1) * sizeof(bench_au_t))))
+                return -1;
+            *aus = tmp;
+        }
+        (*aus)[count].data = buf + au_start;
+        (*aus)[count].size = size - au_start;
+        count++;
+    }
+    return sps_valid ? count : -1;
+}
+
+/* Memory the process has resident now in kB. The peak counters of the system cover the whole process,
+ * so the runs sample this after each call for their own growth */
+static long resident_memory(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return (long)(pmc.WorkingSetSize >> 10);
+#else
+    FILE *f = fopen("/proc/self/statm", "r");
+    long pages = 0;
+    if (!f)
+        return 0;
+    if (fscanf(f, "%*s %ld", &pages) != 1)
+        pages = 0;
+    fclose(f);
+    return pages * (sysconf(_SC_PAGESIZE) >> 10);
+#endif
+}
+
+/* 4:2:0 frame of depth bits (8 or 10), a gradient with some noise. Returns -1 if out of memory */
+static int bench_source(uint8_t *src[3], int linesize[3], int width, int height, int depth)
+{
+    int bytes = depth > 8 ? 2 : 1;
+    int i, x, y;
+
+    for (i = 0; i < 3; i++)
+    {
+        int w = i ? width / 2 : width;
+        int h = i ? height / 2 : height;
+
+        linesize[i] = w * bytes;
+        if (!(src[i] = av_malloc((size_t)linesize[i] * h)))
+            return -1;
+        for (y = 0; y < h; y++)
+            for (x = 0; x < w; x++)
+            {
+                int v = 64 + (x + y) % 876 + (x * 7 + y * 13) % 5;
+                if (bytes == 2)
+                    ((uint16_t *)(src[i] + (intptr_t)y * linesize[i]))[x] = v & 1023;
+                else
+                    src[i][(intptr_t)y * linesize[i] + x] = v >> 2;
+            }
+    }
+    return 0;
+}
+
+/* 8-bit 4:2:0 to I420 or NV12 of the same size: swscale as x264vfw_init_sws_context sets it up at the
+ * default quality against the plane copy of X264VFW_CONVERT_COPY. One thread */
+static void bench_copy(int width, int height, int nv12)
+{
+    enum AVPixelFormat dst_fmt = nv12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+    int frames = width * height > 2073600 ? 25 : 100;
+    struct SwsContext *sws;
+    uint8_t *src[3] = { NULL }, *dst[3] = { NULL };
+    int src_linesize[3], dst_linesize[3] = { 0 };
+    int64_t start, time_sws, time_copy;
+    int i;
+
+    if (bench_source(src, src_linesize, width, height, 8) < 0)
+        goto end;
+    dst_linesize[0] = width;
+    dst_linesize[1] = nv12 ? width : width / 2;
+    dst_linesize[2] = nv12 ? 0 : width / 2;
+    if (!(dst[0] = av_malloc((size_t)width * height * 3 / 2)))
+        goto end;
+    dst[1] = dst[0] + (intptr_t)width * height;
+    dst[2] = nv12 ? NULL : dst[1] + (intptr_t)width * height / 4;
+
+    sws = sws_getContext(width, height, AV_PIX_FMT_YUV420P, width, height, dst_fmt,
+                         SWS_BICUBIC | SWS_FULL_CHR_H_INP | SWS_ACCURATE_RND, NULL, NULL, NULL);
+    if (!sws)
+    {
+        fprintf(stderr, "sws_getContext failed\n");
+        goto end;
+    }
+    start = x264vfw_mdate();
+    for (i = 0; i < frames; i++)
+        sws_scale(sws, (const uint8_t * const *)src, src_linesize, 0, height, dst, dst_linesize);
+    time_sws = x264vfw_mdate() - start;
+    sws_freeContext(sws);
+
+    start = x264vfw_mdate();
+    for (i = 0; i < frames; i++)
+    {
+        x264vfw_plane_copy(dst[0], dst_linesize[0], src[0], src_linesize[0], width, height);
+        if (nv12)
+            x264vfw_plane_copy_interleave(dst[1], dst_linesize[1], src[1], src_linesize[1], src[2], src_linesize[2],
+                                          width / 2, height / 2);
+        else
+        {
+            x264vfw_plane_copy(dst[1], dst_linesize[1], src[1], src_linesize[1], width / 2, height / 2);
+            x264vfw_plane_copy(dst[2], dst_linesize[2], src[2], src_linesize[2], width / 2, height / 2);
+        }
+    }
+    time_copy = x264vfw_mdate() - start;
+
+    printf("%dx%d 8-bit -> %-4s  swscale %8.2f ms/frame  copy %8.2f ms/frame  %6.1fx\n", width, height,
+           nv12 ? "NV12" : "I420", time_sws / 1000.0 / frames, time_copy / 1000.0 / frames,
+           time_copy ? (double)time_sws / time_copy : 0.0);
+end:
+    for (i = 0; i < 3; i++)
+        av_free(src[i]);
+    av_free(dst[0]);
+}
+
+/* 8-bit 4:2:0 BT.709 to BGRA or BGR24 of the same size: swscale at a quality (X264VFW_QUALITY_*), as
+ * x264vfw_init_sws_context sets it up, against x264vfw_yuv2rgb which replaces it there. swscale converts its
+ * last two rows with its C code, which rounds differently from its SIMD code x264vfw_yuv2rgb follows, so they
+ * are left out of the comparison. Returns -1 if a byte differs by more than 1 */
+static int bench_rgb(int width, int height, int bgr24, int quality)
+{
+    static const char * const quality_names[] = { "fast", "normal", "high" };
+    static const int quality_flags[] =
+    {
+        SWS_FAST_BILINEAR,
+        SWS_BILINEAR | SWS_ACCURATE_RND,
+        SWS_BICUBIC | SWS_FULL_CHR_H_INP | SWS_ACCURATE_RND
+    };
+    enum AVPixelFormat dst_fmt = bgr24 ? AV_PIX_FMT_BGR24 : AV_PIX_FMT_BGRA;
+    int bpp = bgr24 ? 3 : 4;
+    int frames = width * height > 2073600 ? 25 : 100;
+    const int *coefficients = sws_getCoefficients(SWS_CS_ITU709);
+    x264vfw_csp_function_t pf;
+    x264vfw_yuv2rgb_coeffs_t coeffs;
+    struct SwsContext *sws;
+    uint8_t *src[3] = { NULL }, *dst[3] = { NULL }, *ref = NULL;
+    int src_linesize[3], dst_linesize[3] = { width * bpp };
+    int64_t start, time_sws, time_rgb;
+    int i, max_diff = 0, ret = -1;
+
+    if (bench_source(src, src_linesize, width, height, 8) < 0 ||
+        !(ref = av_malloc((size_t)width * height * bpp)) || !(dst[0] = av_malloc((size_t)width * height * bpp)))
+        goto end;
+
+    sws = sws_getContext(width, height, AV_PIX_FMT_YUV420P, width, height, dst_fmt, quality_flags[quality], NULL, NULL, NULL);
+    if (!sws)
+    {
+        fprintf(stderr, "sws_getContext failed\n");
+        goto end;
+    }
+    sws_setColorspaceDetails(sws, coefficients, 0, coefficients, 0, 0, 1 << 16, 1 << 16);
+    start = x264vfw_mdate();
+    for (i = 0; i < frames; i++)
+        sws_scale(sws, (const uint8_t * const *)src, src_linesize, 0, height, &ref, dst_linesize);
+    time_sws = x264vfw_mdate() - start;
+    sws_freeContext(sws);
+
+    x264vfw_csp_init(x264vfw_cpu_detect(), &pf);
+    x264vfw_yuv2rgb_init(&coeffs, coefficients, 0, quality, 1);
+    start = x264vfw_mdate();
+    for (i = 0; i < frames; i++)
+        x264vfw_yuv2rgb(&pf, &coeffs, bgr24, dst[0], dst_linesize[0], src, src_linesize, 1, width, height, 0, height);
+    time_rgb = x264vfw_mdate() - start;
+
+    for (i = 0; i < width * (height - 2) * bpp; i++)
+        max_diff = X264VFW_MAX(max_diff, abs(dst[0][i] - ref[i]));
+    ret = max_diff > 1 ? -1 : 0;
+    printf("%dx%d 8-bit -> %-5s %-6s swscale %8.2f ms/frame  direct %8.2f ms/frame  %6.1fx  max diff %d%s\n",
+           width, height, bgr24 ? "BGR24" : "BGRA", quality_names[quality], time_sws / 1000.0 / frames, time_rgb / 1000.0 / frames,
+           time_rgb ? (double)time_sws / time_rgb : 0.0, max_diff, ret < 0 ? "  FAILED" : "");
+end:
+    for (i = 0; i < 3; i++)
+        av_free(src[i]);
+    av_free(dst[0]);
+    av_free(ref);
+    return ret;
+}
+
+/* 10-bit 4:2:0 down to 8 bits, swscale set up as x264vfw_init_sws_context does against x264vfw_yuv_dither.
+ * One thread, the frame is a gradient with some noise */
+static void bench_dither(int width, int height, int nv12)
+{
+    enum AVPixelFormat dst_fmt = nv12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+    int frames = width * height > 2073600 ? 25 : 100;
+    x264vfw_csp_function_t pf;
+    struct SwsContext *sws;
+    uint8_t *src[3] = { NULL }, *dst[3] = { NULL };
+    int src_linesize[3], dst_linesize[3] = { 0 };
+    int64_t start, time_sws, time_dither;
+    int i;
+
+    if (bench_source(src, src_linesize, width, height, 10) < 0)
+        goto end;
+    dst_linesize[0] = width;
+    dst_linesize[1] = nv12 ? width : width / 2;
+    dst_linesize[2] = nv12 ? 0 : width / 2;
+    if (!(dst[0] = av_malloc((size_t)width * height * 3 / 2)))
+        goto end;
+    dst[1] = dst[0] + (intptr_t)width * height;
+    dst[2] = nv12 ? NULL : dst[1] + (intptr_t)width * height / 4;
+
+    sws = sws_getContext(width, height, AV_PIX_FMT_YUV420P10LE, width, height, dst_fmt,
+                         SWS_BICUBIC | SWS_FULL_CHR_H_INP | SWS_ACCURATE_RND, NULL, NULL, NULL);
+    if (!sws)
+    {
+        fprintf(stderr, "sws_getContext failed\n");
+        goto end;
+    }
+    start = x264vfw_mdate();
+    for (i = 0; i < frames; i++)
+        sws_scale(sws, (const uint8_t * const *)src, src_linesize, 0, height, dst, dst_linesize);
+    time_sws = x264vfw_mdate() - start;
+    sws_freeContext(sws);
+
+    x264vfw_csp_init(x264vfw_cpu_detect(), &pf);
+    start = x264vfw_mdate();
+    for (i = 0; i < frames; i++)
+        x264vfw_yuv_dither(&pf, dst, dst_linesize, src, src_linesize, 10, nv12, 1, 1, width, 0, height);
+    time_dither = x264vfw_mdate() - start;
+
+    printf("%dx%d 10-bit -> %-4s  swscale %8.2f ms/frame  dither %8.2f ms/frame  %6.1fx\n", width, height,
+           nv12 ? "NV12" : "I420", time_sws / 1000.0 / frames, time_dither / 1000.0 / frames,
+           time_dither ? (double)time_sws / time_dither : 0.0);
+end:
+    for (i = 0; i < 3; i++)
+        av_free(src[i]);
+    av_free(dst[0]);
+}
+
+/* PQ 10-bit 4:2:0 to BGRA: swscale as the driver converted it before the tone mapping (no tone mapping)
+ * against x264vfw_yuv2rgb_tonemap. One thread, the same frame as bench_dither */
+static void bench_tonemap(int width, int height)
+{
+    int frames = width * height > 2073600 ? 25 : 100;
+    x264vfw_csp_function_t pf;
+    x264vfw_tonemap_t *tm = NULL;
+    struct SwsContext *sws;
+    uint8_t *src[3] = { NULL }, *dst[3] = { NULL };
+    int src_linesize[3], dst_linesize[3] = { width * 4 };
+    int64_t start, time_sws, time_tonemap;
+    int i;
+
+    if (bench_source(src, src_linesize, width, height, 10) < 0)
+        goto end;
+    if (!(dst[0] = av_malloc((size_t)width * height * 4)))
+        goto end;
+
+    sws = sws_getContext(width, height, AV_PIX_FMT_YUV420P10LE, width, height, AV_PIX_FMT_BGRA,
+                         SWS_BICUBIC | SWS_FULL_CHR_H_INP | SWS_FULL_CHR_H_INT | SWS_ACCURATE_RND, NULL, NULL, NULL);
+    if (!sws)
+    {
+        fprintf(stderr, "sws_getContext failed\n");
+        goto end;
+    }
+    start = x264vfw_mdate();
+    for (i = 0; i < frames; i++)
+        sws_scale(sws, (const uint8_t * const *)src, src_linesize, 0, height, dst, dst_linesize);
+    time_sws = x264vfw_mdate() - start;
+    sws_freeContext(sws);
+
+    if (!(tm = av_mallocz(sizeof(x264vfw_tonemap_t))))
+        goto end;
+    x264vfw_csp_init(x264vfw_cpu_detect(), &pf);
+    start = x264vfw_mdate();
+    x264vfw_tonemap_init(tm, X264VFW_TONEMAP_PQ, 1, 10, 0, X264VFW_TONEMAP_PEAK);
+    printf("tone mapping tables built in %.2f ms\n", (x264vfw_mdate() - start) / 1000.0);
+    start = x264vfw_mdate();
+    for (i = 0; i < frames; i++)
+        x264vfw_yuv2rgb_tonemap(&pf, tm, 0, dst[0], dst_linesize[0], src, src_linesize, 1, 1, width, 0, height);
+    time_tonemap = x264vfw_mdate() - start;
+
+    printf("%dx%d PQ 10-bit -> BGRA  swscale %8.2f ms/frame  tone mapped %8.2f ms/frame  %6.1fx\n", width, height,
+           time_sws / 1000.0 / frames, time_tonemap / 1000.0 / frames,
+           time_tonemap ? (double)time_sws / time_tonemap : 0.0);
+end:
+    for (i = 0; i < 3; i++)
+        av_free(src[i]);
+    av_free(dst[0]);
+    av_free(tm);
+}
+
+/* Decode the stream into the csp, the last picture is copied into last if it isn't NULL */
+static int bench_run(bench_au_t *aus, int count, int nal_length_size, int width, int height, int csp, const char *name,
+                     const x264vfw_settings_t *settings, uint8_t *last)
+{
+    CODEC codec;
+    x264vfw_rect_t rect = { 0, 0, width, height };
+    enum AVPixelFormat pix_fmt = x264vfw_csp_to_pix_fmt(csp);
+    int picture_size = x264vfw_picture_get_size(pix_fmt, width, height);
+    uint8_t *output;
+    int64_t start, total;
+    uint32_t frames_out;
+    long baseline, peak;
+    int i, ret = 0;
+
+    if (picture_size < 0 || !(output = av_malloc(picture_size)))
+        return -1;
+
+    /* Before the decoder, the growth is what the run takes on top */
+    baseline = peak = resident_memory();
+
+    memset(&codec, 0, sizeof(CODEC));
+    x264vfw_decoder_set_settings(&codec, settings);
+    if (x264vfw_decoder_open(&codec, width, height, nal_length_size ? MKTAG('h','v','c','1') : MKTAG('H','E','V','C'),
+                             NULL, 0, csp) < 0)
+    {
+        fprintf(stderr, "%s: x264vfw_decoder_open failed\n", name);
+        av_free(output);
+        return -1;
+    }
+
+    start = x264vfw_mdate();
+    for (i = 0; i < count; i++)
+    {
+        if (x264vfw_decoder_decode(&codec, aus[i].data, aus[i].size, output, width, height, &rect, &rect, 0) < 0)
+        {
+            fprintf(stderr, "%s: access unit %d failed\n", name, i);
+            break;
+        }
+        peak = X264VFW_MAX(peak, resident_memory());
+    }
+    do
+    {
+        frames_out = codec.stats.frames_out;
+        if (x264vfw_decoder_decode(&codec, NULL, 0, output, width, height, &rect, &rect, 0) < 0)
+            break;
+        peak = X264VFW_MAX(peak, resident_memory());
+    } while (codec.stats.frames_out != frames_out);
+    total = x264vfw_mdate() - start;
+
+    printf("%-5s %6u frames %8.2f fps  copy %8.1f ms  decode %8.1f ms  convert %8.1f ms  growth %ld kB\n",
+           name, codec.stats.frames_out, total ? codec.stats.frames_out * 1000000.0 / total : 0.0,
+           codec.stats.copy.total / 1000.0, codec.stats.decode.total / 1000.0,
+           codec.stats.convert.total / 1000.0, peak - baseline);
+
+    printf("%-5s delay %d frame(s), expected %d\n", name, codec.decoder_delay, x264vfw_decoder_get_expected_delay(&codec));
+    if (codec.decoder_delay > x264vfw_decoder_get_expected_delay(&codec))
+    {
+        fprintf(stderr, "%s: the delay exceeds the expected one\n", name);
+        ret = -1;
+    }
+
+    if (last)
+        memcpy(last, output, picture_size);
+    x264vfw_decoder_close(&codec);
+    av_free(output);
+    return ret;
+}
+
+/* Conversion threads from 1 to one per CPU. The pictures of the bands must be the same as the one of
+ * the whole picture */
+static int bench_bands(bench_au_t *aus, int count, int nal_length_size, int width, int height, int csp, const char *name,
+                       const x264vfw_settings_t *settings)
+{
+    x264vfw_settings_t band_settings = *settings;
+    int picture_size = x264vfw_picture_get_size(x264vfw_csp_to_pix_fmt(csp), width, height);
+    int threads = X264VFW_MIN(x264vfw_cpu_num_processors(), X264VFW_THREAD_MAX);
+    uint8_t *whole = NULL, *bands = NULL;
+    char band_name[32];
+    int i, j, diff, ret = -1;
+
+    if (picture_size < 0 || !(whole = av_malloc(picture_size)) || !(bands = av_malloc(picture_size)))
+        goto end;
+    for (i = 1; i <= threads; i++)
+    {
+        band_settings.convert_threads = i;
+        snprintf(band_name, sizeof(band_name), "%s/%d", name, i);
+        if (bench_run(aus, count, nal_length_size, width, height, csp, band_name, &band_settings, i == 1 ? whole : bands) < 0)
+            goto end;
+        if (i == 1)
+            continue;
+        for (diff = 0, j = 0; j < picture_size; j++)
+            diff += whole[j] != bands[j];
+        if (diff)
+        {
+            fprintf(stderr, "%s: %d bytes differ from the whole picture\n", band_name, diff);
+            goto end;
+        }
+    }
+    ret = 0;
+end:
+    av_free(whole);
+    av_free(bands);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    x264vfw_hevc_sps_t sps;
+    x264vfw_settings_t settings;
+    bench_au_t *aus;
+    uint8_t *buf;
+    int size, count, nal_length_size;
+    int scaling = 0, failed = 0;
+    int i;
+
+    if (argc >= 2 && !strcmp(argv[1], "-c"))
+    {
+        for (i = 0; i < 2; i++)
+        {
+            bench_copy(1920, 1080, i);
+            bench_copy(3840, 2160, i);
+        }
+        return 0;
+    }
+    if (argc >= 2 && !strcmp(argv[1], "-r"))
+    {
+        int quality;
+        for (quality = X264VFW_QUALITY_FAST; quality <= X264VFW_QUALITY_HIGH; quality++)
+            for (i = 0; i < 2; i++)
+            {
+                failed |= bench_rgb(1920, 1080, i, quality) < 0;
+                failed |= bench_rgb(3840, 2160, i, quality) < 0;
+            }
+        return failed;
+    }
+    if (argc >= 2 && !strcmp(argv[1], "-d"))
+    {
+        for (i = 0; i < 2; i++)
+        {
+            bench_dither(1920, 1080, i);
+            bench_dither(3840, 2160, i);
+        }
+        return 0;
+    }
+    if (argc >= 2 && !strcmp(argv[1], "-t"))
+    {
+        bench_tonemap(1920, 1080);
+        bench_tonemap(3840, 2160);
+        return 0;
+    }
+    if (argc >= 2 && !strcmp(argv[1], "-s"))
+    {
+        scaling = 1;
+        argc--;
+        argv++;
+    }
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <raw hevc stream> [csp]\n"
+                        "       %s -s <raw hevc stream> [csp]\n"
+                        "                conversion threads from 1 to one per CPU, fails if the picture\n"
+                        "                changes with the number of bands\n"
+                        "       %s -c    8-bit output of the same layout, swscale against the plane copy\n"
+                        "       %s -r    8-bit to RGB, swscale at each quality against the direct path,\n"
+                        "                fails if they differ by more than 1\n"
+                        "       %s -d    10 to 8-bit conversion, swscale against the dither kernel\n"
+                        "       %s -t    PQ to BGRA, swscale against the tone mapping kernel\n"
+                        "  the stream runs fail if the decoder delays the output more than the stream and the threading\n"
+                        "  mode should give\n"
+                        "  the X264VFW_<KEY> environment variables of the driver set the decoder up\n", argv[0], argv[0], argv[0], argv[0], argv[0],
+                argv[0]);
+        return 1;
+    }
+    if (!(buf = read_file(argv[1], &size)))
+    {
+        fprintf(stderr, "can't read %s\n", argv[1]);
+        return 1;
+    }
+
+    /* Annex B starts with a start code, otherwise take 4-byte NAL unit sizes */
+    nal_length_size = size >= 4 && !buf[0] && !buf[1] && (buf[2] == 1 || (!buf[2] && buf[3] == 1)) ? 0 : 4;
+    memset(&sps, 0, sizeof(sps));
+    if ((count = split_access_units(buf, size, nal_length_size, &aus, &sps)) < 0)
+    {
+        fprintf(stderr, "no SPS found in %s\n", argv[1]);
+        free(buf);
+        return 1;
+    }
+    printf("%s: %dx%d, %d access units, %s\n", argv[1], sps.width, sps.height, count,
+           nal_length_size ? "size prefixed" : "Annex B");
+
+    x264vfw_mutex_init(&x264vfw_CS);
+    avcodec_register_all();
+    x264vfw_decoder_load();
+    x264vfw_settings_default(&settings);
+    x264vfw_settings_read_env(&settings);
+
+    for (i = 0; i < sizeof(bench_csp) / sizeof(bench_csp[0]); i++)
+        if (argc < 3 || !strcmp(argv[2], bench_csp[i].name))
+        {
+            if (scaling)
+                failed |= bench_bands(aus, count, nal_length_size, sps.width, sps.height, bench_csp[i].csp,
+                                      bench_csp[i].name, &settings) < 0;
+            else
+                failed |= bench_run(aus, count, nal_length_size, sps.width, sps.height, bench_csp[i].csp,
+                                    bench_csp[i].name, &settings, NULL) < 0;
+        }
+
+    x264vfw_decoder_unload();
+    x264vfw_mutex_destroy(&x264vfw_CS);
+    free(aus);
+    free(buf);
+    return failed;
+}
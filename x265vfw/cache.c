@@ -0,0 +1,176 @@
+/*****************************************************************************
+ * cache.c: cache of converted frames
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "cache.h"
+
+typedef struct x264vfw_cache_entry_t
+{
+    uint64_t key;
+    uint64_t state;
+    int      size;
+    struct x264vfw_cache_entry_t *prev; /* more recently used */
+    struct x264vfw_cache_entry_t *next;
+    /* frame data follows */
+} x264vfw_cache_entry_t;
+
+/* Every entry is a whole frame so there are only tens of them, a list is enough */
+struct x264vfw_cache_t
+{
+    x264vfw_cache_entry_t *head;
+    x264vfw_cache_entry_t *tail;
+    x264vfw_cache_stats_t stats;
+};
+
+#define ENTRY_DATA(e) ((uint8_t *)((e) + 1))
+
+static inline uint64_t hash_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t x264vfw_hash(const uint8_t *buf, size_t size, uint64_t seed)
+{
+    uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+    uint64_t v;
+
+    for (; size >= 8; buf += 8, size -= 8)
+    {
+        memcpy(&v, buf, 8);
+        h = (h ^ hash_mix(v)) * 0x9e3779b97f4a7c15ULL;
+    }
+    v = 0;
+    memcpy(&v, buf, size);
+    return hash_mix(h ^ v);
+}
+
+static void cache_unlink(x264vfw_cache_t *cache, x264vfw_cache_entry_t *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        cache->head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        cache->tail = e->prev;
+}
+
+static void cache_push_front(x264vfw_cache_t *cache, x264vfw_cache_entry_t *e)
+{
+    e->prev = NULL;
+    e->next = cache->head;
+    if (cache->head)
+        cache->head->prev = e;
+    else
+        cache->tail = e;
+    cache->head = e;
+}
+
+static void cache_remove(x264vfw_cache_t *cache, x264vfw_cache_entry_t *e)
+{
+    cache_unlink(cache, e);
+    cache->stats.entries--;
+    cache->stats.bytes -= e->size;
+    free(e);
+}
+
+int x264vfw_cache_init(x264vfw_cache_t **p_cache, uint64_t budget)
+{
+    x264vfw_cache_t *cache;
+
+    *p_cache = NULL;
+    if (!budget)
+        return -1;
+    cache = calloc(1, sizeof(x264vfw_cache_t));
+    if (!cache)
+        return -1;
+    cache->stats.budget = budget;
+    *p_cache = cache;
+    return 0;
+}
+
+int x264vfw_cache_get(x264vfw_cache_t *cache, uint64_t key, uint8_t *dst, int size, uint64_t *state)
+{
+    x264vfw_cache_entry_t *e;
+
+    for (e = cache->head; e; e = e->next)
+        if (e->key == key && e->size == size)
+        {
+            if (dst)
+                memcpy(dst, ENTRY_DATA(e), size);
+            if (state)
+                *state = e->state;
+            cache_unlink(cache, e);
+            cache_push_front(cache, e);
+            cache->stats.hits++;
+            return 0;
+        }
+    cache->stats.misses++;
+    return -1;
+}
+
+void x264vfw_cache_put(x264vfw_cache_t *cache, uint64_t key, const uint8_t *src, int size, uint64_t state)
+{
+    x264vfw_cache_entry_t *e;
+
+    if (size <= 0 || size > cache->stats.budget)
+        return;
+    for (e = cache->head; e; e = e->next)
+        if (e->key == key)
+        {
+            cache_remove(cache, e);
+            break;
+        }
+    while (cache->tail && cache->stats.bytes + size > cache->stats.budget)
+    {
+        cache_remove(cache, cache->tail);
+        cache->stats.evictions++;
+    }
+
+    e = malloc(sizeof(x264vfw_cache_entry_t) + size);
+    if (!e)
+        return;
+    e->key = key;
+    e->state = state;
+    e->size = size;
+    memcpy(ENTRY_DATA(e), src, size);
+    cache_push_front(cache, e);
+    cache->stats.entries++;
+    cache->stats.bytes += size;
+}
+
+void x264vfw_cache_get_stats(x264vfw_cache_t *cache, x264vfw_cache_stats_t *stats)
+{
+    *stats = cache->stats;
+}
+
+void x264vfw_cache_delete(x264vfw_cache_t *cache)
+{
+    if (!cache)
+        return;
+    while (cache->head)
+        cache_remove(cache, cache->head);
+    free(cache);
+}
@@ -0,0 +1,51 @@
+/*****************************************************************************
+ * cache.h: cache of converted frames
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_CACHE_H
+#define X264VFW_CACHE_H
+
+#include "common.h"
+
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t entries;
+    uint64_t bytes;
+    uint64_t budget;
+} x264vfw_cache_stats_t;
+
+typedef struct x264vfw_cache_t x264vfw_cache_t;
+
+/* Fast non-cryptographic 64-bit hash */
+uint64_t x264vfw_hash(const uint8_t *buf, size_t size, uint64_t seed);
+
+/* LRU cache which holds at most budget bytes of frame data. Returns 0 on success */
+int  x264vfw_cache_init(x264vfw_cache_t **p_cache, uint64_t budget);
+/* Copy the frame with the key into dst (if not NULL) and the state stored with it into *state (if not NULL).
+ * Returns 0 on a hit */
+int  x264vfw_cache_get(x264vfw_cache_t *cache, uint64_t key, uint8_t *dst, int size, uint64_t *state);
+/* Add a frame with a state of the caller, evicting the least recently used ones to stay within the budget */
+void x264vfw_cache_put(x264vfw_cache_t *cache, uint64_t key, const uint8_t *src, int size, uint64_t state);
+void x264vfw_cache_get_stats(x264vfw_cache_t *cache, x264vfw_cache_stats_t *stats);
+void x264vfw_cache_delete(x264vfw_cache_t *cache);
+
+#endif
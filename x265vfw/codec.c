@@ -25,10 +25,6 @@
 
 #include "x265vfw.h"
 
-#include <assert.h>
-
-#include <getopt.h>
-
 const named_fourcc_t x264vfw_fourcc_table[COUNT_FOURCC] =
 {
     { "HEVC", mmioFOURCC('H','E','V','C') },
@@ -72,6 +68,21 @@ static int get_csp(BITMAPINFOHEADER *hdr)
         case FOURCC_HDYC:
             return X264VFW_CSP_UYVY | i_vflip;
 
+        case FOURCC_P010:
+            return X264VFW_CSP_P010 | i_vflip;
+
+        case FOURCC_P016:
+            return X264VFW_CSP_P016 | i_vflip;
+
+        case FOURCC_V210:
+            return X264VFW_CSP_V210 | i_vflip;
+
+        case FOURCC_Y410:
+            return X264VFW_CSP_Y410 | i_vflip;
+
+        case FOURCC_Y416:
+            return X264VFW_CSP_Y416 | i_vflip;
+
         case BI_RGB:
         {
             i_vflip = hdr->biHeight < 0 ? 0 : X264VFW_CSP_VFLIP;
@@ -87,201 +98,53 @@ static int get_csp(BITMAPINFOHEADER *hdr)
     }
 }
 
-static enum AVPixelFormat csp_to_pix_fmt(int i_csp)
+/* Inverse of get_csp, RGB bitmaps are bottom-up */
+static void x264vfw_csp_format(int i_csp, DWORD *fourcc, int *bitcount)
 {
-    i_csp &= X264VFW_CSP_MASK;
     switch (i_csp)
     {
-        case X264VFW_CSP_I420:
-        case X264VFW_CSP_YV12:
-            return AV_PIX_FMT_YUV420P;
-
-        //case X264VFW_CSP_I422:
-        case X264VFW_CSP_YV16:
-            return AV_PIX_FMT_YUV422P;
-
-        //case X264VFW_CSP_I444:
-        case X264VFW_CSP_YV24:
-            return AV_PIX_FMT_YUV444P;
-
-        case X264VFW_CSP_NV12:
-            return AV_PIX_FMT_NV12;
-
-        case X264VFW_CSP_YUYV:
-            return AV_PIX_FMT_YUYV422;
-
-        case X264VFW_CSP_UYVY:
-            return AV_PIX_FMT_UYVY422;
-
-        case X264VFW_CSP_BGR:
-            return AV_PIX_FMT_BGR24;
-
-        case X264VFW_CSP_BGRA:
-            return AV_PIX_FMT_BGRA;
-
-        default:
-            return AV_PIX_FMT_NONE;
-    }
-}
-
-static int x264vfw_picture_fill(AVPicture *picture, uint8_t *ptr, enum AVPixelFormat pix_fmt, int width, int height)
-{
-    memset(picture, 0, sizeof(AVPicture));
-
-    switch (pix_fmt)
-    {
-        case AV_PIX_FMT_YUV420P:
-        {
-            int size, size2;
-            height = (height + 1) & ~1;
-            width = (width + 1) & ~1;
-            picture->linesize[0] = width;
-            picture->linesize[1] =
-            picture->linesize[2] = width / 2;
-            size  = picture->linesize[0] * height;
-            size2 = picture->linesize[1] * height / 2;
-            picture->data[0] = ptr;
-            picture->data[1] = picture->data[0] + size;
-            picture->data[2] = picture->data[1] + size2;
-            return size + 2 * size2;
-        }
-
-        case AV_PIX_FMT_YUV422P:
-        {
-            int size, size2;
-            width = (width + 1) & ~1;
-            picture->linesize[0] = width;
-            picture->linesize[1] =
-            picture->linesize[2] = width / 2;
-            size  = picture->linesize[0] * height;
-            size2 = picture->linesize[1] * height;
-            picture->data[0] = ptr;
-            picture->data[1] = picture->data[0] + size;
-            picture->data[2] = picture->data[1] + size2;
-            return size + 2 * size2;
-        }
-
-        case AV_PIX_FMT_YUV444P:
-        {
-            int size;
-            picture->linesize[0] =
-            picture->linesize[1] =
-            picture->linesize[2] = width;
-            size  = picture->linesize[0] * height;
-            picture->data[0] = ptr;
-            picture->data[1] = picture->data[0] + size;
-            picture->data[2] = picture->data[1] + size;
-            return 3 * size;
-        }
-
-        case AV_PIX_FMT_NV12:
-        {
-            int size;
-            height = (height + 1) & ~1;
-            width = (width + 1) & ~1;
-            picture->linesize[0] =
-            picture->linesize[1] = width;
-            size  = picture->linesize[0] * height;
-            picture->data[0] = ptr;
-            picture->data[1] = picture->data[0] + size;
-            return size + size / 2;
-        }
-
-        case AV_PIX_FMT_YUYV422:
-        case AV_PIX_FMT_UYVY422:
-            width = (width + 1) & ~1;
-            picture->linesize[0] = width * 2;
-            picture->data[0] = ptr;
-            return picture->linesize[0] * height;
-
-        case AV_PIX_FMT_BGR24:
-            picture->linesize[0] = (width * 3 + 3) & ~3;
-            picture->data[0] = ptr;
-            return picture->linesize[0] * height;
-
-        case AV_PIX_FMT_BGRA:
-            picture->linesize[0] = width * 4;
-            picture->data[0] = ptr;
-            return picture->linesize[0] * height;
-
-        default:
-            return -1;
+        case X264VFW_CSP_I420: *fourcc = FOURCC_I420; *bitcount = 12; break;
+        case X264VFW_CSP_YV12: *fourcc = FOURCC_YV12; *bitcount = 12; break;
+        case X264VFW_CSP_YV16: *fourcc = FOURCC_YV16; *bitcount = 16; break;
+        case X264VFW_CSP_YV24: *fourcc = FOURCC_YV24; *bitcount = 24; break;
+        case X264VFW_CSP_NV12: *fourcc = FOURCC_NV12; *bitcount = 12; break;
+        case X264VFW_CSP_YUYV: *fourcc = FOURCC_YUY2; *bitcount = 16; break;
+        case X264VFW_CSP_UYVY: *fourcc = FOURCC_UYVY; *bitcount = 16; break;
+        case X264VFW_CSP_P010: *fourcc = FOURCC_P010; *bitcount = 24; break;
+        case X264VFW_CSP_P016: *fourcc = FOURCC_P016; *bitcount = 24; break;
+        case X264VFW_CSP_V210: *fourcc = FOURCC_V210; *bitcount = 20; break;
+        case X264VFW_CSP_Y410: *fourcc = FOURCC_Y410; *bitcount = 32; break;
+        case X264VFW_CSP_Y416: *fourcc = FOURCC_Y416; *bitcount = 64; break;
+        case X264VFW_CSP_BGR:  *fourcc = BI_RGB;      *bitcount = 24; break;
+        default:               *fourcc = BI_RGB;      *bitcount = 32; break;
     }
 }
 
-static int x264vfw_picture_get_size(enum AVPixelFormat pix_fmt, int width, int height)
+static int supported_fourcc(DWORD fourcc)
 {
-    AVPicture dummy_pict;
-    return x264vfw_picture_fill(&dummy_pict, NULL, pix_fmt, width, height);
+    int i;
+    for (i = 0; i < COUNT_FOURCC; i++)
+        if (fourcc == x264vfw_fourcc_table[i].value)
+            return TRUE;
+    return FALSE;
 }
 
-static int x264vfw_picture_vflip(AVPicture *picture, enum AVPixelFormat pix_fmt, int width, int height)
+/* Get the SPS of the stream from the extradata or from the parameter sets seen in-band */
+static int x264vfw_get_stream_sps(CODEC *codec, BITMAPINFOHEADER *inhdr, x264vfw_hevc_sps_t *sps)
 {
-    switch (pix_fmt)
+    if (inhdr->biSize > sizeof(BITMAPINFOHEADER) && inhdr->biSize < (1 << 30))
     {
-        // only RGB-formats can need vflip
-        case AV_PIX_FMT_BGR24:
-        case AV_PIX_FMT_BGRA:
-            picture->data[0] += picture->linesize[0] * (height - 1);
-            picture->linesize[0] = -picture->linesize[0];
-            break;
-
-        default:
-            return -1;
+        uint8_t *buf = (uint8_t *)inhdr + sizeof(BITMAPINFOHEADER);
+        int buf_size = inhdr->biSize - sizeof(BITMAPINFOHEADER);
+        if (x264vfw_hevc_parse_extradata(sps, buf, buf_size) == 0)
+            return 0;
     }
-    return 0;
-}
-
-static void x264vfw_fill_black_frame(uint8_t *ptr, enum AVPixelFormat pix_fmt, int picture_size)
-{
-    switch (pix_fmt)
+    if (codec->decoder_sps_valid)
     {
-        case AV_PIX_FMT_YUV420P:
-        case AV_PIX_FMT_NV12:
-        {
-            int luma_size = picture_size * 2 / 3;
-            memset(ptr, 0x10, luma_size); /* TV Scale */
-            memset(ptr + luma_size, 0x80, picture_size - luma_size);
-            break;
-        }
-
-        case AV_PIX_FMT_YUV422P:
-        {
-            int luma_size = picture_size / 2;
-            memset(ptr, 0x10, luma_size); /* TV Scale */
-            memset(ptr + luma_size, 0x80, picture_size - luma_size);
-            break;
-        }
-
-        case AV_PIX_FMT_YUV444P:
-        {
-            int luma_size = picture_size / 3;
-            memset(ptr, 0x10, luma_size); /* TV Scale */
-            memset(ptr + luma_size, 0x80, picture_size - luma_size);
-            break;
-        }
-
-        case AV_PIX_FMT_YUYV422:
-            wmemset((wchar_t *)ptr, 0x8010, picture_size / sizeof(wchar_t)); /* TV Scale */
-            break;
-
-        case AV_PIX_FMT_UYVY422:
-            wmemset((wchar_t *)ptr, 0x1080, picture_size / sizeof(wchar_t)); /* TV Scale */
-            break;
-
-        default:
-            memset(ptr, 0x00, picture_size);
-            break;
+        *sps = codec->decoder_sps;
+        return 0;
     }
-}
-
-static int supported_fourcc(DWORD fourcc)
-{
-    int i;
-    for (i = 0; i < COUNT_FOURCC; i++)
-        if (fourcc == x264vfw_fourcc_table[i].value)
-            return TRUE;
-    return FALSE;
+    return -1;
 }
 
 LRESULT x264vfw_decompress_get_format(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *lpbiOutput)
@@ -291,6 +154,10 @@ LRESULT x264vfw_decompress_get_format(CODEC *codec, BITMAPINFO *lpbiInput, BITMA
     int              iWidth;
     int              iHeight;
     int              picture_size;
+    int              i_csp = X264VFW_CSP_BGRA;
+    int              i_bitcount = 32;
+    DWORD            fourcc = BI_RGB;
+    x264vfw_hevc_sps_t sps;
 
     if (!lpbiOutput)
         return sizeof(BITMAPINFOHEADER);
@@ -306,7 +173,40 @@ LRESULT x264vfw_decompress_get_format(CODEC *codec, BITMAPINFO *lpbiInput, BITMA
     if (iWidth % 2 || iHeight % 2)
         return ICERR_BADFORMAT;
 
-    picture_size = x264vfw_picture_get_size(AV_PIX_FMT_BGRA, iWidth, iHeight);
+    /* Propose the native layout of the stream so hosts which accept YUV don't need any colorspace conversion */
+    if (codec->settings.output_csp != X264VFW_CSP_NONE)
+    {
+        i_csp = codec->settings.output_csp;
+        x264vfw_csp_format(i_csp, &fourcc, &i_bitcount);
+    }
+    else if (x264vfw_get_stream_sps(codec, inhdr, &sps) == 0)
+    {
+        switch (sps.chroma_format_idc)
+        {
+            case 1:
+                i_csp = X264VFW_CSP_YV12;
+                i_bitcount = 12;
+                fourcc = FOURCC_YV12;
+                break;
+
+            case 2:
+                i_csp = X264VFW_CSP_YV16;
+                i_bitcount = 16;
+                fourcc = FOURCC_YV16;
+                break;
+
+            case 3:
+                i_csp = X264VFW_CSP_YV24;
+                i_bitcount = 24;
+                fourcc = FOURCC_YV24;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    picture_size = x264vfw_picture_get_size(x264vfw_csp_to_pix_fmt(i_csp), iWidth, iHeight);
     if (picture_size < 0)
         return ICERR_BADFORMAT;
 
@@ -315,13 +215,51 @@ LRESULT x264vfw_decompress_get_format(CODEC *codec, BITMAPINFO *lpbiInput, BITMA
     outhdr->biWidth       = iWidth;
     outhdr->biHeight      = iHeight;
     outhdr->biPlanes      = 1;
-    outhdr->biBitCount    = 32;
-    outhdr->biCompression = BI_RGB;
+    outhdr->biBitCount    = i_bitcount;
+    outhdr->biCompression = fourcc;
     outhdr->biSizeImage   = picture_size;
 
     return ICERR_OK;
 }
 
+/* Get the rectangle, a non-positive size means the whole bitmap */
+static int x264vfw_get_rect(x264vfw_rect_t *rect, int x, int y, int dx, int dy, int width, int height)
+{
+    if (dx <= 0 || dy <= 0)
+    {
+        rect->x = rect->y = 0;
+        rect->width = width;
+        rect->height = height;
+        return 0;
+    }
+    if (x < 0 || y < 0 || (int64_t)x + dx > width || (int64_t)y + dy > height)
+        return -1;
+    rect->x = x;
+    rect->y = y;
+    rect->width = dx;
+    rect->height = dy;
+    return 0;
+}
+
+/* Check and get the rectangles of ICM_DECOMPRESSEX. The source corner must be on a chroma sample
+ * and so must be the whole destination rectangle for YUV formats. The packed high bit depth formats
+ * can't be stretched and the V210 rectangle starts on a group of 6 pixels */
+static int x264vfw_get_ex_rects(ICDECOMPRESSEX *icd, enum AVPixelFormat pix_fmt, x264vfw_rect_t *src, x264vfw_rect_t *dst)
+{
+    if (x264vfw_get_rect(src, icd->xSrc, icd->ySrc, icd->dxSrc, icd->dySrc, icd->lpbiSrc->biWidth, abs(icd->lpbiSrc->biHeight)) < 0 ||
+        x264vfw_get_rect(dst, icd->xDst, icd->yDst, icd->dxDst, icd->dyDst, icd->lpbiDst->biWidth, abs(icd->lpbiDst->biHeight)) < 0)
+        return -1;
+    if ((src->x | src->y) & 1)
+        return -1;
+    if (pix_fmt != AV_PIX_FMT_BGR24 && pix_fmt != AV_PIX_FMT_BGRA && ((dst->x | dst->y | dst->width | dst->height) & 1))
+        return -1;
+    if (X264VFW_PIX_FMT_IS_PACKED_HBD(pix_fmt) && (src->width != dst->width || src->height != dst->height))
+        return -1;
+    if (pix_fmt == X264VFW_PIX_FMT_V210 && dst->x % 6)
+        return -1;
+    return 0;
+}
+
 LRESULT x264vfw_decompress_query(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *lpbiOutput)
 {
     BITMAPINFOHEADER *inhdr = &lpbiInput->bmiHeader;
@@ -353,7 +291,7 @@ LRESULT x264vfw_decompress_query(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO
     if (i_csp == X264VFW_CSP_NONE)
         return ICERR_BADFORMAT;
 
-    pix_fmt = csp_to_pix_fmt(i_csp);
+    pix_fmt = x264vfw_csp_to_pix_fmt(i_csp);
     if (pix_fmt == AV_PIX_FMT_NONE)
         return ICERR_BADFORMAT;
 
@@ -369,451 +307,371 @@ LRESULT x264vfw_decompress_query(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO
     return ICERR_OK;
 }
 
-LRESULT x264vfw_decompress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *lpbiOutput)
+/* Like x264vfw_decompress_query but the output bitmap may have any size, the rectangles are checked instead */
+LRESULT x264vfw_decompress_query_ex(CODEC *codec, ICDECOMPRESSEX *icd)
 {
-    int i_csp;
+    BITMAPINFOHEADER *outhdr = icd->lpbiDst;
+    x264vfw_rect_t   src, dst;
+    int              i_csp;
+    int              picture_size;
+    enum AVPixelFormat pix_fmt;
+    LRESULT          ret;
 
-    x264vfw_decompress_end(codec);
+    ret = x264vfw_decompress_query(codec, (BITMAPINFO *)icd->lpbiSrc, NULL);
+    if (ret != ICERR_OK || !outhdr)
+        return ret;
 
-    if (x264vfw_decompress_query(codec, lpbiInput, lpbiOutput) != ICERR_OK)
-    {
-        DPRINTF("incompatible input/output frame format (decode)\n");
+    if (outhdr->biWidth <= 0 || outhdr->biHeight == 0)
         return ICERR_BADFORMAT;
-    }
 
-    i_csp = get_csp(&lpbiOutput->bmiHeader);
-    codec->decoder_vflip = (i_csp & X264VFW_CSP_VFLIP) != 0;
-    i_csp &= X264VFW_CSP_MASK;
-    codec->decoder_pix_fmt = csp_to_pix_fmt(i_csp);
-    codec->decoder_swap_UV = i_csp == X264VFW_CSP_YV12 || i_csp == X264VFW_CSP_YV16 || i_csp == X264VFW_CSP_YV24;
+    i_csp = get_csp(outhdr);
+    if (i_csp == X264VFW_CSP_NONE)
+        return ICERR_BADFORMAT;
 
-    codec->decoder = avcodec_find_decoder(AV_CODEC_ID_HEVC);
-    if (!codec->decoder)
-    {
-        DPRINTF("avcodec_find_decoder failed\n");
-        return ICERR_ERROR;
-    }
+    pix_fmt = x264vfw_csp_to_pix_fmt(i_csp);
+    if (pix_fmt == AV_PIX_FMT_NONE)
+        return ICERR_BADFORMAT;
 
-    codec->decoder_context = avcodec_alloc_context3(codec->decoder);
-    if (!codec->decoder_context)
-    {
-        DPRINTF("avcodec_alloc_context failed\n");
-        return ICERR_ERROR;
-    }
+    picture_size = x264vfw_picture_get_size(pix_fmt, outhdr->biWidth, abs(outhdr->biHeight));
+    if (picture_size < 0)
+        return ICERR_BADFORMAT;
+    if (outhdr->biSizeImage != 0 && outhdr->biSizeImage < picture_size)
+        return ICERR_BADFORMAT;
 
-    codec->decoder_frame = av_frame_alloc();
-    if (!codec->decoder_frame)
-    {
-        DPRINTF("av_frame_alloc failed\n");
-        av_freep(&codec->decoder_context);
-        return ICERR_ERROR;
-    }
+    if (x264vfw_get_ex_rects(icd, pix_fmt, &src, &dst) < 0)
+        return ICERR_BADFORMAT;
 
-    codec->decoder_context->thread_count = 0; //minimize latency
-    codec->decoder_context->coded_width  = lpbiInput->bmiHeader.biWidth;
-    codec->decoder_context->coded_height = lpbiInput->bmiHeader.biHeight;
-    codec->decoder_context->codec_tag = lpbiInput->bmiHeader.biCompression;
+    return ICERR_OK;
+}
 
-    if (lpbiInput->bmiHeader.biSize > sizeof(BITMAPINFOHEADER) + 4 && lpbiInput->bmiHeader.biSize < (1 << 30))
-    {
-        uint8_t *buf = (uint8_t *)&lpbiInput->bmiHeader + sizeof(BITMAPINFOHEADER);
-        uint32_t buf_size = lpbiInput->bmiHeader.biSize - sizeof(BITMAPINFOHEADER);
-        /* Check supported formats of extradata */
-        if ((buf[0] == 0x00 && buf[1] == 0x00 && buf[2] == 0x00 && buf[3] == 0x01) ||
-            (buf_size >= 7 && buf[0] == 0x01 && (buf[4] & 0xfc) == 0xfc && (buf[5] & 0xe0) == 0xe0))
-        {
-            codec->decoder_extradata = av_malloc(buf_size + FF_INPUT_BUFFER_PADDING_SIZE);
-            if (codec->decoder_extradata)
-            {
-                codec->decoder_is_avc = buf[0] == 0x01;
-                memcpy(codec->decoder_extradata, buf, buf_size);
-                memset(codec->decoder_extradata + buf_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-                codec->decoder_context->extradata = codec->decoder_extradata;
-                codec->decoder_context->extradata_size = buf_size;
-            }
-        }
-    }
+/* Copy of a BITMAPINFOHEADER together with whatever follows it (extradata, color masks) */
+static void *x264vfw_format_dup(const BITMAPINFOHEADER *hdr)
+{
+    DWORD size = X264VFW_MAX(hdr->biSize, sizeof(BITMAPINFOHEADER));
+    void *copy;
 
-    if (avcodec_open2(codec->decoder_context, codec->decoder, NULL) < 0)
+    if (size >= (1 << 30) || !(copy = av_malloc(size)))
+        return NULL;
+    memcpy(copy, hdr, size);
+    return copy;
+}
+
+static int x264vfw_format_equal(const void *saved, const BITMAPINFOHEADER *hdr)
+{
+    const BITMAPINFOHEADER *prev = saved;
+    return prev && prev->biSize == hdr->biSize &&
+           memcmp(prev, hdr, X264VFW_MAX(hdr->biSize, sizeof(BITMAPINFOHEADER))) == 0;
+}
+
+/* Open the decoder for the formats of ICM_DECOMPRESS[EX]_BEGIN */
+static LRESULT x264vfw_decompress_open(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *lpbiOutput)
+{
+    BITMAPINFOHEADER *inhdr = &lpbiInput->bmiHeader;
+    const uint8_t *extradata = NULL;
+    int extradata_size = 0;
+    int ret;
+
+    if (inhdr->biSize > sizeof(BITMAPINFOHEADER) && inhdr->biSize < (1 << 30))
     {
-        DPRINTF("avcodec_open failed\n");
-        av_freep(&codec->decoder_context);
-        av_frame_free(&codec->decoder_frame);
-        av_freep(&codec->decoder_extradata);
-        return ICERR_ERROR;
+        extradata = (uint8_t *)inhdr + sizeof(BITMAPINFOHEADER);
+        extradata_size = inhdr->biSize - sizeof(BITMAPINFOHEADER);
     }
 
-    av_init_packet(&codec->decoder_pkt);
-    codec->decoder_pkt.data = NULL;
-    codec->decoder_pkt.size = 0;
+    ret = x264vfw_decoder_open(codec, inhdr->biWidth, inhdr->biHeight, inhdr->biCompression,
+                               extradata, extradata_size, get_csp(&lpbiOutput->bmiHeader));
+    if (ret == X264VFW_DECODER_BADFORMAT)
+        return ICERR_BADFORMAT;
+    if (ret < 0)
+        return ICERR_ERROR;
 
+    /* Kept to recognize a BEGIN which can reuse this decoder */
+    codec->decoder_format_in = x264vfw_format_dup(inhdr);
+    codec->decoder_format_out = x264vfw_format_dup(&lpbiOutput->bmiHeader);
     return ICERR_OK;
 }
 
-/* handle the deprecated jpeg pixel formats */
-static int handle_jpeg(int pix_fmt, int *fullrange)
+/* Hosts begin again on every seek, with an unchanged format only the decoder state has to go */
+static int x264vfw_decompress_restart(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *lpbiOutput)
 {
-    switch (pix_fmt)
-    {
-        case AV_PIX_FMT_YUVJ420P: *fullrange = 1; return AV_PIX_FMT_YUV420P;
-        case AV_PIX_FMT_YUVJ422P: *fullrange = 1; return AV_PIX_FMT_YUV422P;
-        case AV_PIX_FMT_YUVJ444P: *fullrange = 1; return AV_PIX_FMT_YUV444P;
-        default:                                  return pix_fmt;
-    }
+    if (!x264vfw_format_equal(codec->decoder_format_in, &lpbiInput->bmiHeader) ||
+        !x264vfw_format_equal(codec->decoder_format_out, &lpbiOutput->bmiHeader))
+        return -1;
+    return x264vfw_decoder_restart(codec);
 }
 
-static struct SwsContext *x264vfw_init_sws_context(CODEC *codec, int dst_width, int dst_height)
+LRESULT x264vfw_decompress_begin(CODEC *codec, BITMAPINFO *lpbiInput, BITMAPINFO *lpbiOutput)
 {
-    struct SwsContext *sws = sws_alloc_context();
-    if (!sws)
-        return NULL;
+    if (x264vfw_decompress_query(codec, lpbiInput, lpbiOutput) != ICERR_OK)
+    {
+        DPRINTF("incompatible input/output frame format (decode)\n");
+        x264vfw_decompress_close(codec);
+        return ICERR_BADFORMAT;
+    }
+    if (x264vfw_decompress_restart(codec, lpbiInput, lpbiOutput) == 0)
+        return ICERR_OK;
 
-    int flags = SWS_BICUBIC |
-                SWS_FULL_CHR_H_INP | SWS_ACCURATE_RND;
+    x264vfw_decompress_close(codec);
+    return x264vfw_decompress_open(codec, lpbiInput, lpbiOutput);
+}
 
-    int src_width = codec->decoder_context->width;
-    int src_height = codec->decoder_context->height;
-    if (!src_width || !src_height)
+LRESULT x264vfw_decompress_begin_ex(CODEC *codec, ICDECOMPRESSEX *icd)
+{
+    if (x264vfw_decompress_query_ex(codec, icd) != ICERR_OK)
     {
-        src_width = codec->decoder_context->coded_width;
-        src_height = codec->decoder_context->coded_height;
+        DPRINTF("incompatible input/output frame format (decode)\n");
+        x264vfw_decompress_close(codec);
+        return ICERR_BADFORMAT;
     }
-    int src_range = codec->decoder_context->color_range == AVCOL_RANGE_JPEG;
-    int src_pix_fmt = handle_jpeg(codec->decoder_context->pix_fmt, &src_range);
+    /* The rectangles are taken from every ICDECOMPRESSEX, they don't need a new decoder */
+    if (x264vfw_decompress_restart(codec, (BITMAPINFO *)icd->lpbiSrc, (BITMAPINFO *)icd->lpbiDst) == 0)
+        return ICERR_OK;
 
-    int dst_range = src_range; //maintain source range
-    int dst_pix_fmt = handle_jpeg(codec->decoder_pix_fmt, &dst_range);
+    x264vfw_decompress_close(codec);
+    return x264vfw_decompress_open(codec, (BITMAPINFO *)icd->lpbiSrc, (BITMAPINFO *)icd->lpbiDst);
+}
 
-    av_opt_set_int(sws, "sws_flags",  flags,       0);
+/* Bytes of the frame to decode, 0 asks for the delayed frames */
+static uint32_t x264vfw_frame_size(BITMAPINFOHEADER *inhdr, uint8_t *input)
+{
+#if X264VFW_USE_VIRTUALDUB_HACK
+    /* VirtualDub's null frame stands for a frame delayed by the encoder, use it to drain our delayed frames */
+    if (inhdr->biSizeImage == 1 && input[0] == 0x7f)
+        return 0;
+#endif
+    return inhdr->biSizeImage;
+}
 
-    av_opt_set_int(sws, "srcw",       src_width,   0);
-    av_opt_set_int(sws, "srch",       src_height,  0);
-    av_opt_set_int(sws, "src_format", src_pix_fmt, 0);
-    av_opt_set_int(sws, "src_range",  src_range,   0);
+static int x264vfw_decode_flags(DWORD dwFlags)
+{
+    int flags = 0;
+
+    /* The host won't show the picture, only the decoder state matters */
+    if (dwFlags & (ICDECOMPRESS_HURRYUP | ICDECOMPRESS_PREROLL))
+        flags |= X264VFW_DECODE_HIDDEN;
+    if (dwFlags & ICDECOMPRESS_NOTKEYFRAME)
+        flags |= X264VFW_DECODE_NOTKEY;
+    return flags;
+}
 
-    av_opt_set_int(sws, "dstw",       dst_width,   0);
-    av_opt_set_int(sws, "dsth",       dst_height,  0);
-    av_opt_set_int(sws, "dst_format", dst_pix_fmt, 0);
-    av_opt_set_int(sws, "dst_range",  dst_range,   0);
+static LRESULT x264vfw_decompress_frame(CODEC *codec, BITMAPINFOHEADER *inhdr, uint8_t *input,
+                                        BITMAPINFOHEADER *outhdr, uint8_t *output,
+                                        const x264vfw_rect_t *src, const x264vfw_rect_t *dst, DWORD dwFlags)
+{
+    if (x264vfw_decoder_decode(codec, input, x264vfw_frame_size(inhdr, input), output, outhdr->biWidth, abs(outhdr->biHeight),
+                               src, dst, x264vfw_decode_flags(dwFlags)) < 0)
+        return ICERR_ERROR;
+    return ICERR_OK;
+}
 
-    /* SWS_FULL_CHR_H_INT is correctly supported only for RGB formats */
-    if (dst_pix_fmt == AV_PIX_FMT_BGR24 || dst_pix_fmt == AV_PIX_FMT_BGRA)
-        flags |= SWS_FULL_CHR_H_INT;
+LRESULT x264vfw_decompress(CODEC *codec, ICDECOMPRESS *icd)
+{
+    x264vfw_rect_t rect = { 0, 0, icd->lpbiInput->biWidth, icd->lpbiInput->biHeight };
+    LRESULT ret = x264vfw_decompress_frame(codec, icd->lpbiInput, icd->lpInput, icd->lpbiOutput, icd->lpOutput, &rect, &rect, icd->dwFlags);
+    //icd->lpbiOutput->biSizeImage = picture_size;
+    return ret;
+}
 
-    const int *coefficients = NULL;
-    switch (codec->decoder_context->colorspace)
-    {
-        case AVCOL_SPC_BT709:
-            coefficients = sws_getCoefficients(SWS_CS_ITU709);
-            break;
-        case AVCOL_SPC_FCC:
-            coefficients = sws_getCoefficients(SWS_CS_FCC);
-            break;
-        case AVCOL_SPC_BT470BG:
-            coefficients = sws_getCoefficients(SWS_CS_ITU601);
-            break;
-        case AVCOL_SPC_SMPTE170M:
-            coefficients = sws_getCoefficients(SWS_CS_SMPTE170M);
-            break;
-        case AVCOL_SPC_SMPTE240M:
-            coefficients = sws_getCoefficients(SWS_CS_SMPTE240M);
-            break;
-        default:
-            coefficients = sws_getCoefficients(SWS_CS_DEFAULT);
-            break;
-    }
-    sws_setColorspaceDetails(sws,
-                             coefficients, src_range,
-                             coefficients, dst_range,
-                             0, 1<<16, 1<<16);
+LRESULT x264vfw_decompress_ex(CODEC *codec, ICDECOMPRESSEX *icd)
+{
+    x264vfw_rect_t src, dst;
+    LRESULT ret;
 
-    if (sws_init_context(sws, NULL, NULL) < 0)
+    if (x264vfw_get_ex_rects(icd, codec->decoder_pix_fmt, &src, &dst) < 0)
     {
-        sws_freeContext(sws);
-        return NULL;
+        DPRINTF("invalid source or destination rectangle\n");
+        return ICERR_BADPARAM;
     }
-    return sws;
+    ret = x264vfw_decompress_frame(codec, icd->lpbiSrc, icd->lpSrc, icd->lpbiDst, icd->lpDst, &src, &dst, icd->dwFlags);
+    //icd->lpbiDst->biSizeImage = picture_size;
+    return ret;
 }
 
-LRESULT x264vfw_decompress(CODEC *codec, ICDECOMPRESS *icd)
+LRESULT x264vfw_decompress_get_delay(CODEC *codec)
 {
-    BITMAPINFOHEADER *inhdr = icd->lpbiInput;
-    DWORD neededsize = inhdr->biSizeImage + FF_INPUT_BUFFER_PADDING_SIZE;
-    int len, got_picture;
-    AVPicture picture;
-    int picture_size;
+    return x264vfw_decoder_get_delay(codec);
+}
 
-    got_picture = 0;
-#if X264VFW_USE_VIRTUALDUB_HACK
-    if (!(inhdr->biSizeImage == 1 && ((uint8_t *)icd->lpInput)[0] == 0x7f))
-    {
-#endif
-        /* Check overflow */
-        if (neededsize < FF_INPUT_BUFFER_PADDING_SIZE)
-        {
-            DPRINTF("buffer overflow check failed\n");
-            return ICERR_ERROR;
-        }
-        if (codec->decoder_buf_size < neededsize)
-        {
-            av_free(codec->decoder_buf);
-            codec->decoder_buf_size = 0;
-            codec->decoder_buf = av_malloc(neededsize);
-            if (!codec->decoder_buf)
-            {
-                DPRINTF("failed to realloc decoder buffer\n");
-                return ICERR_ERROR;
-            }
-            codec->decoder_buf_size = neededsize;
-        }
-        memcpy(codec->decoder_buf, icd->lpInput, inhdr->biSizeImage);
-        memset(codec->decoder_buf + inhdr->biSizeImage, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-        codec->decoder_pkt.data = codec->decoder_buf;
-        codec->decoder_pkt.size = inhdr->biSizeImage;
+LRESULT x264vfw_decompress_set_keyframe_only(CODEC *codec, int enable)
+{
+    x264vfw_decoder_set_keyframe_only(codec, enable);
+    return ICERR_OK;
+}
 
-        if (inhdr->biSizeImage >= 4 && !codec->decoder_is_avc)
-        {
-            uint8_t *buf = codec->decoder_buf;
-            uint32_t buf_size = inhdr->biSizeImage;
-            uint32_t nal_size = endian_fix32(*(uint32_t *)buf);
-            /* Check startcode */
-            if (nal_size != 0x00000001)
-            {
-                /* Check that this is correct size prefixed format */
-                while ((uint64_t)buf_size >= (uint64_t)nal_size + 8)
-                {
-                    buf += nal_size + 4;
-                    buf_size -= nal_size + 4;
-                    nal_size = endian_fix32(*(uint32_t *)buf);
-                }
-                if ((uint64_t)buf_size == (uint64_t)nal_size + 4)
-                {
-                    /* Convert to Annex B */
-                    buf = codec->decoder_buf;
-                    buf_size = inhdr->biSizeImage;
-                    nal_size = endian_fix32(*(uint32_t *)buf);
-                    *(uint32_t *)buf = endian_fix32(0x00000001);
-                    while ((uint64_t)buf_size >= (uint64_t)nal_size + 8)
-                    {
-                        buf += nal_size + 4;
-                        buf_size -= nal_size + 4;
-                        nal_size = endian_fix32(*(uint32_t *)buf);
-                        *(uint32_t *)buf = endian_fix32(0x00000001);
-                    }
-                }
-            }
-        }
+/* With no buffer the size of the state is returned, which hosts allocate before asking for it */
+LRESULT x264vfw_decompress_get_state(CODEC *codec, void *state, DWORD size)
+{
+    if (!state)
+        return sizeof(x264vfw_settings_t);
+    if (size < sizeof(x264vfw_settings_t))
+        return ICERR_BADSIZE;
+    memcpy(state, &codec->settings, sizeof(x264vfw_settings_t));
+    return ICERR_OK;
+}
 
-        len = avcodec_decode_video2(codec->decoder_context, codec->decoder_frame, &got_picture, &codec->decoder_pkt);
-        if (len < 0)
-        {
-            DPRINTF("avcodec_decode_video2 failed\n");
-            return ICERR_ERROR;
-        }
-#if X264VFW_USE_VIRTUALDUB_HACK
-    }
-#endif
+/* Returns the bytes of the state used, 0 for a state which isn't ours */
+LRESULT x264vfw_decompress_set_state(CODEC *codec, const void *state, DWORD size)
+{
+    x264vfw_settings_t settings = codec->settings;
+    int used;
+
+    if ((used = x264vfw_settings_from_blob(&settings, state, (int)X264VFW_MIN(size, 1 << 30))) < 0)
+        return 0;
+    /* The decoder is opened again at the next BEGIN, see x264vfw_decoder_restart */
+    x264vfw_decoder_set_settings(codec, &settings);
+    return used;
+}
 
-    picture_size = x264vfw_picture_get_size(codec->decoder_pix_fmt, inhdr->biWidth, inhdr->biHeight);
-    if (picture_size < 0)
-    {
-        DPRINTF("x264vfw_picture_get_size failed\n");
-        return ICERR_ERROR;
-    }
+LRESULT x264vfw_decompress_get_cache_stats(CODEC *codec, x264vfw_cache_stats_t *stats, DWORD size)
+{
+    if (!stats || size < sizeof(x264vfw_cache_stats_t))
+        return ICERR_BADPARAM;
+    if (x264vfw_decoder_get_cache_stats(codec, stats) < 0)
+        return ICERR_UNSUPPORTED;
+    return ICERR_OK;
+}
 
-    if (!got_picture)
-    {
-        /* Frame was decoded but delayed so we would show the BLACK-frame instead */
-        x264vfw_fill_black_frame(icd->lpOutput, codec->decoder_pix_fmt, picture_size);
-        //icd->lpbiOutput->biSizeImage = picture_size;
-        return ICERR_OK;
-    }
+LRESULT x264vfw_decompress_get_stats(CODEC *codec, x264vfw_stats_t *stats, DWORD size)
+{
+    if (!stats || size < sizeof(x264vfw_stats_t))
+        return ICERR_BADPARAM;
+    x264vfw_decoder_get_stats(codec, stats);
+    return ICERR_OK;
+}
 
-    if (x264vfw_picture_fill(&picture, icd->lpOutput, codec->decoder_pix_fmt, inhdr->biWidth, inhdr->biHeight) < 0)
-    {
-        DPRINTF("x264vfw_picture_fill failed\n");
-        return ICERR_ERROR;
-    }
-    if (codec->decoder_swap_UV)
-    {
-        uint8_t *temp_data;
-        int     temp_linesize;
-
-        temp_data = picture.data[1];
-        temp_linesize = picture.linesize[1];
-        picture.data[1] = picture.data[2];
-        picture.linesize[1] = picture.linesize[2];
-        picture.data[2] = temp_data;
-        picture.linesize[2] = temp_linesize;
-    }
-    if (codec->decoder_vflip)
-        if (x264vfw_picture_vflip(&picture, codec->decoder_pix_fmt, inhdr->biWidth, inhdr->biHeight) < 0)
-        {
-            DPRINTF("x264vfw_picture_vflip failed\n");
-            return ICERR_ERROR;
-        }
+LRESULT x264vfw_decompress_end(CODEC *codec)
+{
+    /* The decoder is kept for the next BEGIN, see x264vfw_decompress_close */
+    x264vfw_decoder_end(codec);
+    return ICERR_OK;
+}
 
-    if (!codec->sws)
-    {
-        codec->sws = x264vfw_init_sws_context(codec, inhdr->biWidth, inhdr->biHeight);
-        if (!codec->sws)
-        {
-            DPRINTF("x264vfw_init_sws_context failed\n");
-            return ICERR_ERROR;
-        }
-    }
+static uint32_t x264vfw_format_size(const BITMAPINFOHEADER *hdr)
+{
+    if (!hdr)
+        return 0;
+    return hdr->biSize >= sizeof(BITMAPINFOHEADER) && hdr->biSize < (1 << 30) ? hdr->biSize : sizeof(BITMAPINFOHEADER);
+}
 
-    sws_scale(codec->sws, (const uint8_t * const *)codec->decoder_frame->data, codec->decoder_frame->linesize, 0, inhdr->biHeight, picture.data, picture.linesize);
-    //icd->lpbiOutput->biSizeImage = picture_size;
+static void x264vfw_record_begin(CODEC *codec, BITMAPINFOHEADER *inhdr, BITMAPINFOHEADER *outhdr,
+                                 LRESULT result, int64_t start, int64_t end)
+{
+    struct
+    {
+        x264vfw_trace_begin_t begin;
+        x264vfw_settings_t    settings;
+    } head;
+
+    memset(&head, 0, sizeof(head));
+    head.begin.csp = get_csp(outhdr);
+    head.begin.in_size = x264vfw_format_size(inhdr);
+    head.begin.out_size = x264vfw_format_size(outhdr);
+    head.begin.settings_size = sizeof(x264vfw_settings_t);
+    /* The INI file, the environment and ICM_SETSTATE as the next open takes them, the replay starts from those */
+    head.settings = codec->settings;
+    head.settings.keyframe_only = codec->decoder_keyframe_only;
+    x264vfw_trace_write(codec->trace, X264VFW_TRACE_BEGIN, result, start, end,
+                        &head, sizeof(head), inhdr, head.begin.in_size, outhdr, head.begin.out_size);
+}
 
-    return ICERR_OK;
+static void x264vfw_record_frame(CODEC *codec, BITMAPINFOHEADER *inhdr, uint8_t *input, BITMAPINFOHEADER *outhdr,
+                                 const x264vfw_rect_t *src, const x264vfw_rect_t *dst, DWORD dwFlags,
+                                 LRESULT result, int64_t start, int64_t end)
+{
+    x264vfw_trace_frame_t frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.flags = x264vfw_decode_flags(dwFlags);
+    frame.vfw_flags = dwFlags;
+    frame.width = outhdr->biWidth;
+    frame.height = abs(outhdr->biHeight);
+    frame.src[0] = src->x;
+    frame.src[1] = src->y;
+    frame.src[2] = src->width;
+    frame.src[3] = src->height;
+    frame.dst[0] = dst->x;
+    frame.dst[1] = dst->y;
+    frame.dst[2] = dst->width;
+    frame.dst[3] = dst->height;
+    x264vfw_trace_write(codec->trace, X264VFW_TRACE_FRAME, result, start, end,
+                        &frame, sizeof(frame), input, x264vfw_frame_size(inhdr, input), NULL, 0);
 }
 
-LRESULT x264vfw_decompress_ex(CODEC *codec, ICDECOMPRESSEX *icd)
+/* Record a message which DriverProc has just handled, start and end are x264vfw_trace_time */
+void x264vfw_decompress_record(CODEC *codec, UINT uMsg, LPARAM lParam1, LPARAM lParam2,
+                               LRESULT result, int64_t start, int64_t end)
 {
-    BITMAPINFOHEADER *inhdr = icd->lpbiSrc;
-    DWORD neededsize = inhdr->biSizeImage + FF_INPUT_BUFFER_PADDING_SIZE;
-    int len, got_picture;
-    AVPicture picture;
-    int picture_size;
+    BITMAPINFO *lpbiInput = (BITMAPINFO *)lParam1;
+    BITMAPINFO *lpbiOutput = (BITMAPINFO *)lParam2;
+    ICDECOMPRESSEX *icdex = (ICDECOMPRESSEX *)lParam1;
+    ICDECOMPRESS *icd = (ICDECOMPRESS *)lParam1;
+    BITMAPINFOHEADER *inhdr;
 
-    got_picture = 0;
-#if X264VFW_USE_VIRTUALDUB_HACK
-    if (!(inhdr->biSizeImage == 1 && ((uint8_t *)icd->lpSrc)[0] == 0x7f))
+    switch (uMsg)
     {
-#endif
-        /* Check overflow */
-        if (neededsize < FF_INPUT_BUFFER_PADDING_SIZE)
-        {
-            DPRINTF("buffer overflow check failed\n");
-            return ICERR_ERROR;
-        }
-        if (codec->decoder_buf_size < neededsize)
+        case ICM_DECOMPRESS_GET_FORMAT:
+        case ICM_DECOMPRESS_QUERY:
+            inhdr = lpbiInput ? &lpbiInput->bmiHeader : NULL;
+            x264vfw_trace_write(codec->trace, uMsg == ICM_DECOMPRESS_QUERY ? X264VFW_TRACE_QUERY : X264VFW_TRACE_GET_FORMAT,
+                                result, start, end, inhdr, x264vfw_format_size(inhdr), NULL, 0, NULL, 0);
+            break;
+
+        case ICM_DECOMPRESSEX_QUERY:
+            inhdr = icdex ? icdex->lpbiSrc : NULL;
+            x264vfw_trace_write(codec->trace, X264VFW_TRACE_QUERY, result, start, end,
+                                inhdr, x264vfw_format_size(inhdr), NULL, 0, NULL, 0);
+            break;
+
+        case ICM_DECOMPRESS_BEGIN:
+            if (lpbiInput && lpbiOutput)
+                x264vfw_record_begin(codec, &lpbiInput->bmiHeader, &lpbiOutput->bmiHeader, result, start, end);
+            break;
+
+        case ICM_DECOMPRESSEX_BEGIN:
+            if (icdex && icdex->lpbiSrc && icdex->lpbiDst)
+                x264vfw_record_begin(codec, icdex->lpbiSrc, icdex->lpbiDst, result, start, end);
+            break;
+
+        case ICM_DECOMPRESS:
         {
-            av_free(codec->decoder_buf);
-            codec->decoder_buf_size = 0;
-            codec->decoder_buf = av_malloc(neededsize);
-            if (!codec->decoder_buf)
-            {
-                DPRINTF("failed to realloc decoder buffer\n");
-                return ICERR_ERROR;
-            }
-            codec->decoder_buf_size = neededsize;
+            x264vfw_rect_t rect = { 0, 0, icd->lpbiInput->biWidth, icd->lpbiInput->biHeight };
+            x264vfw_record_frame(codec, icd->lpbiInput, icd->lpInput, icd->lpbiOutput, &rect, &rect, icd->dwFlags,
+                                 result, start, end);
+            break;
         }
-        memcpy(codec->decoder_buf, icd->lpSrc, inhdr->biSizeImage);
-        memset(codec->decoder_buf + inhdr->biSizeImage, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-        codec->decoder_pkt.data = codec->decoder_buf;
-        codec->decoder_pkt.size = inhdr->biSizeImage;
 
-        if (inhdr->biSizeImage >= 4 && !codec->decoder_is_avc)
+        case ICM_DECOMPRESSEX:
         {
-            uint8_t *buf = codec->decoder_buf;
-            uint32_t buf_size = inhdr->biSizeImage;
-            uint32_t nal_size = endian_fix32(*(uint32_t *)buf);
-            /* Check startcode */
-            if (nal_size != 0x00000001)
+            x264vfw_rect_t src, dst;
+            /* Rejected rectangles never reached the decoder, they are recorded as empty */
+            if (x264vfw_get_ex_rects(icdex, codec->decoder_pix_fmt, &src, &dst) < 0)
             {
-                /* Check that this is correct size prefixed format */
-                while ((uint64_t)buf_size >= (uint64_t)nal_size + 8)
-                {
-                    buf += nal_size + 4;
-                    buf_size -= nal_size + 4;
-                    nal_size = endian_fix32(*(uint32_t *)buf);
-                }
-                if ((uint64_t)buf_size == (uint64_t)nal_size + 4)
-                {
-                    /* Convert to Annex B */
-                    buf = codec->decoder_buf;
-                    buf_size = inhdr->biSizeImage;
-                    nal_size = endian_fix32(*(uint32_t *)buf);
-                    *(uint32_t *)buf = endian_fix32(0x00000001);
-                    while ((uint64_t)buf_size >= (uint64_t)nal_size + 8)
-                    {
-                        buf += nal_size + 4;
-                        buf_size -= nal_size + 4;
-                        nal_size = endian_fix32(*(uint32_t *)buf);
-                        *(uint32_t *)buf = endian_fix32(0x00000001);
-                    }
-                }
+                memset(&src, 0, sizeof(src));
+                memset(&dst, 0, sizeof(dst));
             }
+            x264vfw_record_frame(codec, icdex->lpbiSrc, icdex->lpSrc, icdex->lpbiDst, &src, &dst, icdex->dwFlags,
+                                 result, start, end);
+            break;
         }
 
-        len = avcodec_decode_video2(codec->decoder_context, codec->decoder_frame, &got_picture, &codec->decoder_pkt);
-        if (len < 0)
-        {
-            DPRINTF("avcodec_decode_video2 failed\n");
-            return ICERR_ERROR;
-        }
-#if X264VFW_USE_VIRTUALDUB_HACK
-    }
-#endif
-
-    picture_size = x264vfw_picture_get_size(codec->decoder_pix_fmt, inhdr->biWidth, inhdr->biHeight);
-    if (picture_size < 0)
-    {
-        DPRINTF("x264vfw_picture_get_size failed\n");
-        return ICERR_ERROR;
-    }
-
-    if (!got_picture)
-    {
-        /* Frame was decoded but delayed so we would show the BLACK-frame instead */
-        x264vfw_fill_black_frame(icd->lpDst, codec->decoder_pix_fmt, picture_size);
-        //icd->lpbiDst->biSizeImage = picture_size;
-        return ICERR_OK;
-    }
-
-    if (x264vfw_picture_fill(&picture, icd->lpDst, codec->decoder_pix_fmt, inhdr->biWidth, inhdr->biHeight) < 0)
-    {
-        DPRINTF("x264vfw_picture_fill failed\n");
-        return ICERR_ERROR;
-    }
-    if (codec->decoder_swap_UV)
-    {
-        uint8_t *temp_data;
-        int     temp_linesize;
-
-        temp_data = picture.data[1];
-        temp_linesize = picture.linesize[1];
-        picture.data[1] = picture.data[2];
-        picture.linesize[1] = picture.linesize[2];
-        picture.data[2] = temp_data;
-        picture.linesize[2] = temp_linesize;
-    }
-    if (codec->decoder_vflip)
-        if (x264vfw_picture_vflip(&picture, codec->decoder_pix_fmt, inhdr->biWidth, inhdr->biHeight) < 0)
-        {
-            DPRINTF("x264vfw_picture_vflip failed\n");
-            return ICERR_ERROR;
-        }
+        case ICM_DECOMPRESS_END:
+        case ICM_DECOMPRESSEX_END:
+            x264vfw_trace_write(codec->trace, X264VFW_TRACE_END, result, start, end, NULL, 0, NULL, 0, NULL, 0);
+            break;
 
-    if (!codec->sws)
-    {
-        codec->sws = x264vfw_init_sws_context(codec, inhdr->biWidth, inhdr->biHeight);
-        if (!codec->sws)
+        case ICM_X264VFW_SET_KEYFRAME_ONLY:
+        case ICM_SETSTATE:
         {
-            DPRINTF("x264vfw_init_sws_context failed\n");
-            return ICERR_ERROR;
+            int32_t keyframe_only = codec->decoder_keyframe_only;
+            x264vfw_trace_write(codec->trace, X264VFW_TRACE_KEYFRAME_ONLY, result, start, end,
+                                &keyframe_only, sizeof(keyframe_only), NULL, 0, NULL, 0);
+            break;
         }
     }
-
-    sws_scale(codec->sws, (const uint8_t * const *)codec->decoder_frame->data, codec->decoder_frame->linesize, 0, inhdr->biHeight, picture.data, picture.linesize);
-    //icd->lpbiDst->biSizeImage = picture_size;
-
-    return ICERR_OK;
 }
 
-LRESULT x264vfw_decompress_end(CODEC *codec)
+void x264vfw_decompress_close(CODEC *codec)
 {
-    codec->decoder_is_avc = 0;
-    if (codec->decoder_context)
-        avcodec_close(codec->decoder_context);
-    av_freep(&codec->decoder_context);
-    av_frame_free(&codec->decoder_frame);
-    av_freep(&codec->decoder_extradata);
-    av_freep(&codec->decoder_buf);
-    codec->decoder_buf_size = 0;
-    sws_freeContext(codec->sws);
-    codec->sws = NULL;
-    return ICERR_OK;
+    x264vfw_decoder_close(codec);
+    av_freep(&codec->decoder_format_in);
+    av_freep(&codec->decoder_format_out);
 }
@@ -29,8 +29,14 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <sys/stat.h>
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
 #include <wchar.h>
 
 #include "config.h"
@@ -65,6 +71,9 @@
 
 #define asm __asm__
 
+#define X264VFW_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define X264VFW_MAX(a, b) ((a) > (b) ? (a) : (b))
+
 #if WORDS_BIGENDIAN
 #define endian_fix32(x) (x)
 #elif HAVE_X86_INLINE_ASM && HAVE_MMX
@@ -86,6 +95,71 @@ static ALWAYS_INLINE uint32_t endian_fix32( uint32_t x )
 }
 #endif
 
+/* Mutex of the code which is shared with the non-VFW builds */
+#ifdef _WIN32
+typedef CRITICAL_SECTION x264vfw_mutex_t;
+#define x264vfw_mutex_init(m)    InitializeCriticalSection(m)
+#define x264vfw_mutex_destroy(m) DeleteCriticalSection(m)
+#define x264vfw_mutex_lock(m)    EnterCriticalSection(m)
+#define x264vfw_mutex_unlock(m)  LeaveCriticalSection(m)
+#else
+typedef pthread_mutex_t x264vfw_mutex_t;
+#define x264vfw_mutex_init(m)    pthread_mutex_init(m, NULL)
+#define x264vfw_mutex_destroy(m) pthread_mutex_destroy(m)
+#define x264vfw_mutex_lock(m)    pthread_mutex_lock(m)
+#define x264vfw_mutex_unlock(m)  pthread_mutex_unlock(m)
+#endif
+
+/* Monotonic time in microseconds */
+static inline int64_t x264vfw_mdate(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    /* Split so the multiplication doesn't overflow after a long uptime */
+    return count.QuadPart / freq.QuadPart * 1000000 + count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* Cheapest monotonic counter for the event trace, its rate is measured against x264vfw_mdate */
+static inline int64_t x264vfw_ticks(void)
+{
+#if HAVE_X86_INLINE_ASM
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (int64_t)hi << 32 | lo;
+#else
+    return x264vfw_mdate();
+#endif
+}
+
+static inline uint32_t x264vfw_thread_id(void)
+{
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#else
+    return (uint32_t)(uintptr_t)pthread_self();
+#endif
+}
+
+/* Returns the value before the addition */
+#ifdef _MSC_VER
+#define x264vfw_atomic_fetch_add(p, v) ((uint32_t)InterlockedExchangeAdd((volatile LONG *)(p), (v)))
+#else
+#define x264vfw_atomic_fetch_add(p, v) __sync_fetch_and_add((p), (v))
+#endif
+
+#ifdef _WIN32
+#define x264vfw_debug_output(s) OutputDebugString(s)
+#else
+#define x264vfw_debug_output(s) fputs(s, stderr)
+#endif
+
 #if X264VFW_DEBUG_OUTPUT
 #define DPRINTF_BUF_SZ 2048
 static inline void DPRINTF(const char *fmt, ...)
@@ -97,7 +171,7 @@ static inline void DPRINTF(const char *fmt, ...)
     memset(buf, 0, sizeof(buf));
     vsnprintf(buf, sizeof(buf) - 1, fmt, arg);
     va_end(arg);
-    OutputDebugString(buf);
+    x264vfw_debug_output(buf);
 }
 static inline void DVPRINTF(const char *fmt, va_list arg)
 {
@@ -105,7 +179,7 @@ static inline void DVPRINTF(const char *fmt, va_list arg)
 
     memset(buf, 0, sizeof(buf));
     vsnprintf(buf, sizeof(buf) - 1, fmt, arg);
-    OutputDebugString(buf);
+    x264vfw_debug_output(buf);
 }
 #else
 static inline void DPRINTF(const char *fmt, ...) {}
@@ -0,0 +1,79 @@
+/*****************************************************************************
+ * cpu.c: cpu detection
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "cpu.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#if HAVE_X86_INTRINSICS
+#include <cpuid.h>
+
+static uint32_t xgetbv0(void)
+{
+    uint32_t eax, edx;
+    /* xgetbv, encoded for old assemblers */
+    asm volatile(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+}
+
+uint32_t x264vfw_cpu_detect(void)
+{
+    uint32_t cpu = 0;
+    uint32_t max_level, eax, ebx, ecx, edx;
+
+    max_level = __get_cpuid_max(0, NULL);
+    if (max_level < 1)
+        return 0;
+
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (edx & bit_SSE2)
+        cpu |= X264VFW_CPU_SSE2;
+    if (ecx & bit_SSSE3)
+        cpu |= X264VFW_CPU_SSSE3;
+
+    /* AVX2 also needs the OS to save the ymm state */
+    if (max_level >= 7 && (ecx & bit_OSXSAVE) && (ecx & bit_AVX) && (xgetbv0() & 0x6) == 0x6)
+    {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if (ebx & bit_AVX2)
+            cpu |= X264VFW_CPU_AVX2;
+    }
+
+    return cpu;
+}
+#else
+uint32_t x264vfw_cpu_detect(void)
+{
+    return 0;
+}
+#endif
+
+int x264vfw_cpu_num_processors(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    return X264VFW_MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+#endif
+}
@@ -0,0 +1,40 @@
+/*****************************************************************************
+ * cpu.h: cpu detection
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_CPU_H
+#define X264VFW_CPU_H
+
+#include "common.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_X86_INTRINSICS 1
+#else
+#define HAVE_X86_INTRINSICS 0
+#endif
+
+/* CPU flags */
+#define X264VFW_CPU_SSE2  0x0001
+#define X264VFW_CPU_SSSE3 0x0002
+#define X264VFW_CPU_AVX2  0x0004
+
+uint32_t x264vfw_cpu_detect(void);
+int      x264vfw_cpu_num_processors(void);
+
+#endif
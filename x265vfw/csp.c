@@ -0,0 +1,989 @@
+/*****************************************************************************
+ * csp.c: colorspace conversion functions
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "csp.h"
+#include "cpu.h"
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if HAVE_X86_INTRINSICS
+#include <immintrin.h>
+#define TARGET(x) __attribute__((target(x)))
+#endif
+
+#define YUV2RGB_SHIFT 13
+#define YUV2RGB_ROUNDER 4
+
+static inline uint8_t clip_uint8(int x)
+{
+    return x & ~255 ? (-x) >> 31 & 255 : x;
+}
+
+void x264vfw_yuv2rgb_init(x264vfw_yuv2rgb_coeffs_t *c, const int *inv_table, int full_range,
+                          int quality, int chroma_shift_h)
+{
+    /* Same derivation as sws_setColorspaceDetails with default brightness/contrast/saturation */
+    int64_t crv = inv_table[0];
+    int64_t cbu = inv_table[1];
+    int64_t cgu = inv_table[2];
+    int64_t cgv = inv_table[3];
+    int64_t cy  = 1 << 16;
+
+    if (!full_range)
+    {
+        cy = (cy * 255) / 219;
+        c->y_offset = 16 << 3;
+    }
+    else
+    {
+        crv = (crv * 224) / 255;
+        cbu = (cbu * 224) / 255;
+        cgu = (cgu * 224) / 255;
+        cgv = (cgv * 224) / 255;
+        c->y_offset = 0;
+    }
+
+#define Q13(x) (int)(((x) + (1 << (15 - YUV2RGB_SHIFT))) >> (16 - YUV2RGB_SHIFT))
+    c->cy  = Q13(cy);
+    c->crv = Q13(crv);
+    c->cbu = Q13(cbu);
+    c->cgu = Q13(cgu);
+    c->cgv = Q13(cgv);
+#undef Q13
+
+    /* 4:2:2 has one chroma row per row whatever the filter */
+    c->filter = chroma_shift_h ? quality : X264VFW_QUALITY_FAST;
+    /* The bicubic filter has more than 2 taps, so swscale takes its accurate rounding output which adds 4
+     * to the luma and chroma scaled by 8 */
+    if (c->filter == X264VFW_QUALITY_HIGH)
+        c->y_offset -= YUV2RGB_ROUNDER;
+}
+
+/* Rows and taps (of 4096) swscale filters the chroma of row y of a picture of height h with: the chroma row
+ * for the fast quality, the chroma row above averaged in on even rows for the normal one and 4 bicubic taps
+ * for the high one, with the taps its filter builder gives near the top and bottom edges.
+ * Returns the rounder of the output */
+static int yuv2rgb_chroma_taps(const x264vfw_yuv2rgb_coeffs_t *c, int chroma_shift_h, int y, int h,
+                               int rows[4], int taps[4])
+{
+    static const int bicubic[5][4] =
+    {
+        { -115,  984, 3572, -346 }, /* even rows, chroma rows y / 2 - 2 .. y / 2 + 1 */
+        { -346, 3571,  985, -115 }, /* odd rows, chroma rows y / 2 - 1 .. y / 2 + 2 */
+        { 4432, -336,    0,    0 }, /* rows 0, 1 and 2, chroma rows 0 .. 3 */
+        { 3226,  985, -115,   -1 },
+        {  959, 3473, -336,   -1 }
+    };
+    int ch = (h + chroma_shift_h) >> chroma_shift_h;
+    int i;
+
+    if (c->filter == X264VFW_QUALITY_FAST)
+    {
+        rows[0] = rows[1] = rows[2] = rows[3] = y >> chroma_shift_h;
+        taps[0] = 4096;
+        taps[1] = taps[2] = taps[3] = 0;
+        return 0;
+    }
+    if (c->filter == X264VFW_QUALITY_NORMAL)
+    {
+        rows[0] = rows[2] = rows[3] = X264VFW_MAX((y - 1) >> 1, 0);
+        rows[1] = y >> 1;
+        taps[0] = (y & 1) ? 4096 : 2048;
+        taps[1] = (y & 1) ? 0 : 2048;
+        taps[2] = taps[3] = 0;
+        return 0;
+    }
+
+    if (y < 3)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            rows[i] = X264VFW_MIN(i, ch - 1);
+            taps[i] = bicubic[2 + y][i];
+        }
+        return YUV2RGB_ROUNDER;
+    }
+    for (i = 0; i < 4; i++)
+    {
+        rows[i] = X264VFW_MIN(X264VFW_MAX((y >> 1) - 2 + (y & 1) + i, 0), ch - 1);
+        taps[i] = bicubic[y & 1][i];
+    }
+    /* Third row from the bottom: the tap past the last chroma row is moved onto it, the middle one rounds up */
+    if ((y & 1) && y == h - 3)
+    {
+        taps[1]++;
+        taps[2] += taps[3];
+        taps[3] = 0;
+    }
+    return YUV2RGB_ROUNDER;
+}
+
+static ALWAYS_INLINE void chroma_vfilter_c_internal(int16_t *dst, const uint8_t * const src[4], const int taps[4],
+                                                    int rounder, int x, int w)
+{
+    for (; x < w; x++)
+        dst[x] = ((taps[0] * (src[0][x] << 7) + taps[1] * (src[1][x] << 7) +
+                   taps[2] * (src[2][x] << 7) + taps[3] * (src[3][x] << 7)) >> 16) + rounder;
+}
+
+static void chroma_vfilter_c(int16_t *dst, const uint8_t * const src[4], const int taps[4], int rounder, int w)
+{
+    chroma_vfilter_c_internal(dst, src, taps, rounder, 0, w);
+}
+
+static ALWAYS_INLINE void yuv2bgra_c_internal(uint8_t *dst, const uint8_t *srcy, const int16_t *srcu, const int16_t *srcv,
+                                              int x, int w, const x264vfw_yuv2rgb_coeffs_t *c)
+{
+    for (; x < w; x++)
+    {
+        int y = ((srcy[x] << 3) - c->y_offset) * c->cy >> 16;
+        int u = srcu[x >> 1] - (128 << 3);
+        int v = srcv[x >> 1] - (128 << 3);
+        dst[4 * x]     = clip_uint8(y + (u * c->cbu >> 16));
+        dst[4 * x + 1] = clip_uint8(y + (u * -c->cgu >> 16) + (v * -c->cgv >> 16));
+        dst[4 * x + 2] = clip_uint8(y + (v * c->crv >> 16));
+        dst[4 * x + 3] = 0xff;
+    }
+}
+
+static void yuv2bgra_c(uint8_t *dst, const uint8_t *srcy, const int16_t *srcu, const int16_t *srcv,
+                       int w, const x264vfw_yuv2rgb_coeffs_t *c)
+{
+    yuv2bgra_c_internal(dst, srcy, srcu, srcv, 0, w, c);
+}
+
+static void bgra_to_bgr_c(uint8_t *dst, const uint8_t *src, int w)
+{
+    int x;
+    for (x = 0; x < w; x++)
+    {
+        dst[3 * x]     = src[4 * x];
+        dst[3 * x + 1] = src[4 * x + 1];
+        dst[3 * x + 2] = src[4 * x + 2];
+    }
+}
+
+static void shl16_c(uint16_t *dst, const uint16_t *src, int w, int shift)
+{
+    int x;
+    for (x = 0; x < w; x++)
+        dst[x] = src[x] << shift;
+}
+
+static void interleave_shl16_c(uint16_t *dst, const uint16_t *srcu, const uint16_t *srcv, int w, int shift)
+{
+    int x;
+    for (x = 0; x < w; x++)
+    {
+        dst[2 * x]     = srcu[x] << shift;
+        dst[2 * x + 1] = srcv[x] << shift;
+    }
+}
+
+/* Bayer matrix, the thresholds of the ordered dither */
+static const uint8_t dither_8x8[8][8] =
+{
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+static void dither_c(uint8_t *dst, const uint16_t *src, int w, const uint16_t dither[8], int shift)
+{
+    int x;
+    for (x = 0; x < w; x++)
+    {
+        int v = (src[x] + dither[x & 7]) >> shift;
+        dst[x] = v > 255 ? 255 : v;
+    }
+}
+
+static void dither_interleave_c(uint8_t *dst, const uint16_t *srcu, const uint16_t *srcv, int w,
+                                const uint16_t dither[8], int shift)
+{
+    int x;
+    for (x = 0; x < w; x++)
+    {
+        int u = (srcu[x] + dither[x & 7]) >> shift;
+        int v = (srcv[x] + dither[x & 7]) >> shift;
+        dst[2 * x]     = u > 255 ? 255 : u;
+        dst[2 * x + 1] = v > 255 ? 255 : v;
+    }
+}
+
+/* Tone mapping, see x264vfw_tonemap_t */
+#define TONEMAP_CLIP(x, max) ((x) < 0 ? 0 : (x) > (max) ? (max) : (x))
+
+static ALWAYS_INLINE void yuv2bgra_tonemap_c_internal(uint8_t *dst, const uint16_t *srcy, const uint16_t *srcu, const uint16_t *srcv,
+                                                      int x, int w, int shift, const x264vfw_tonemap_t *tm)
+{
+    const int *m = tm->gamut;
+
+    for (; x < w; x++)
+    {
+        int y = (srcy[x] - tm->y_offset) * tm->cy + (1 << 15);
+        int u = srcu[x >> shift] - tm->c_offset;
+        int v = srcv[x >> shift] - tm->c_offset;
+        int r = tm->eotf[TONEMAP_CLIP((y + v * tm->crv) >> 16, 1023)];
+        int g = tm->eotf[TONEMAP_CLIP((y - u * tm->cgu - v * tm->cgv) >> 16, 1023)];
+        int b = tm->eotf[TONEMAP_CLIP((y + u * tm->cbu) >> 16, 1023)];
+        int r2 = (m[0] * r + m[1] * g + m[2] * b + (1 << 13)) >> 14;
+        int g2 = (m[3] * r + m[4] * g + m[5] * b + (1 << 13)) >> 14;
+        int b2 = (m[6] * r + m[7] * g + m[8] * b + (1 << 13)) >> 14;
+        dst[4 * x]     = tm->oetf[TONEMAP_CLIP(b2, 65535)];
+        dst[4 * x + 1] = tm->oetf[TONEMAP_CLIP(g2, 65535)];
+        dst[4 * x + 2] = tm->oetf[TONEMAP_CLIP(r2, 65535)];
+        dst[4 * x + 3] = 255;
+    }
+}
+
+static void yuv444_to_bgra_tonemap_c(uint8_t *dst, const uint16_t *srcy, const uint16_t *srcu, const uint16_t *srcv,
+                                     int w, const x264vfw_tonemap_t *tm)
+{
+    yuv2bgra_tonemap_c_internal(dst, srcy, srcu, srcv, 0, w, 0, tm);
+}
+
+static void yuv422_to_bgra_tonemap_c(uint8_t *dst, const uint16_t *srcy, const uint16_t *srcu, const uint16_t *srcv,
+                                     int w, const x264vfw_tonemap_t *tm)
+{
+    yuv2bgra_tonemap_c_internal(dst, srcy, srcu, srcv, 0, w, 1, tm);
+}
+
+/* SMPTE ST 2084 EOTF, nits */
+static double pq_eotf(double e)
+{
+    const double m1 = 2610.0 / 16384;
+    const double m2 = 2523.0 / 4096 * 128;
+    const double c1 = 3424.0 / 4096;
+    const double c2 = 2413.0 / 4096 * 32;
+    const double c3 = 2392.0 / 4096 * 32;
+    double p = pow(e, 1 / m2);
+
+    return 10000 * pow(X264VFW_MAX(p - c1, 0) / (c2 - c3 * p), 1 / m1);
+}
+
+/* ARIB STD-B67 inverse OETF and the OOTF of BT.2100 for a 1000 nits display (gamma 1.2), nits.
+ * The OOTF is applied per component instead of on the luminance */
+static double hlg_eotf(double e)
+{
+    const double a = 0.17883277;
+    const double b = 1 - 4 * a;
+    const double c = 0.5 - a * log(4 * a);
+    double scene = e <= 0.5 ? e * e / 3 : (exp((e - c) / a) + b) / 12;
+
+    return 1000 * pow(scene, 1.2);
+}
+
+void x264vfw_tonemap_init(x264vfw_tonemap_t *tm, int transfer, int bt2020, int depth, int full_range, int peak)
+{
+    /* BT.2087 */
+    static const double bt2020_to_bt709[9] =
+    {
+         1.6605, -0.5876, -0.0728,
+        -0.1246,  1.1329, -0.0083,
+        -0.0182, -0.1006,  1.1187
+    };
+    const double kr = 0.2627, kb = 0.0593, kg = 1 - kr - kb;
+    double ys, cs, w;
+    int i;
+
+    if (transfer == X264VFW_TONEMAP_HLG)
+        peak = 1000;
+    if (tm->transfer == transfer && tm->bt2020 == bt2020 && tm->depth == depth &&
+        tm->full_range == full_range && tm->peak == peak)
+        return;
+    tm->transfer = transfer;
+    tm->bt2020 = bt2020;
+    tm->depth = depth;
+    tm->full_range = full_range;
+    tm->peak = peak;
+
+    if (full_range)
+    {
+        tm->y_offset = 0;
+        ys = cs = 1023.0 / ((1 << depth) - 1);
+    }
+    else
+    {
+        tm->y_offset = 16 << (depth - 8);
+        ys = 1023.0 / (219 << (depth - 8));
+        cs = 1023.0 / (224 << (depth - 8));
+    }
+    tm->c_offset = 1 << (depth - 1);
+    tm->cy  = (int)(ys * 65536 + 0.5);
+    tm->crv = (int)(2 * (1 - kr) * cs * 65536 + 0.5);
+    tm->cbu = (int)(2 * (1 - kb) * cs * 65536 + 0.5);
+    tm->cgu = (int)(2 * (1 - kb) * kb / kg * cs * 65536 + 0.5);
+    tm->cgv = (int)(2 * (1 - kr) * kr / kg * cs * 65536 + 0.5);
+
+    for (i = 0; i < 9; i++)
+        tm->gamut[i] = bt2020 ? (int)lrint(bt2020_to_bt709[i] * 16384) : (i % 4 ? 0 : 16384);
+
+    /* Extended Reinhard in units of the reference white, the peak goes to the SDR peak */
+    w = (double)peak / X264VFW_TONEMAP_WHITE;
+    for (i = 0; i < 1024; i++)
+    {
+        double e = i / 1023.0;
+        double x = (transfer == X264VFW_TONEMAP_HLG ? hlg_eotf(e) : pq_eotf(e)) / X264VFW_TONEMAP_WHITE;
+        double y = x * (1 + x / (w * w)) / (1 + x);
+        tm->eotf[i] = (uint16_t)(X264VFW_MIN(y, 1.0) * 65535 + 0.5);
+    }
+    tm->eotf[1024] = tm->eotf[1025] = 0;
+
+    for (i = 0; i < 65536; i++)
+    {
+        double l = i / 65535.0;
+        double v = l < 0.018 ? 4.5 * l : 1.099 * pow(l, 0.45) - 0.099;
+        tm->oetf[i] = (uint8_t)(v * 255 + 0.5);
+    }
+    memset(tm->oetf + 65536, 0, 4);
+}
+
+/* Sample x of a row of 8-bit (hbd = 0) or 16-bit samples */
+#define SAMPLE(p, x) (hbd ? ((const uint16_t *)(p))[x] : (p)[x])
+/* Scaled to 10 bits, one of up and down is 0 */
+#define SAMPLE10(p, x) ((uint32_t)SAMPLE(p, x) << up >> down)
+
+/* Groups of 6 pixels: U0 Y0 V0, Y1 U2 Y2, V2 Y3 U4, Y4 V4 Y5. The last group repeats the last pixel */
+static ALWAYS_INLINE void pack_v210_internal(uint32_t *dst, const uint8_t *srcy, const uint8_t *srcu, const uint8_t *srcv,
+                                             int w, int shift_w, int up, int down, int hbd)
+{
+    int x;
+    for (x = 0; x < w; x += 6, dst += 4)
+    {
+        uint32_t y[6], u[3], v[3];
+        int i;
+        for (i = 0; i < 6; i++)
+            y[i] = SAMPLE10(srcy, X264VFW_MIN(x + i, w - 1));
+        for (i = 0; i < 3; i++)
+        {
+            int cx = X264VFW_MIN(x + 2 * i, w - 1) >> shift_w;
+            u[i] = SAMPLE10(srcu, cx);
+            v[i] = SAMPLE10(srcv, cx);
+        }
+        dst[0] = u[0] | y[0] << 10 | v[0] << 20;
+        dst[1] = y[1] | u[1] << 10 | y[2] << 20;
+        dst[2] = v[1] | y[3] << 10 | u[2] << 20;
+        dst[3] = y[4] | v[2] << 10 | y[5] << 20;
+    }
+}
+
+static ALWAYS_INLINE void pack_y410_internal(uint32_t *dst, const uint8_t *srcy, const uint8_t *srcu, const uint8_t *srcv,
+                                             int w, int shift_w, int up, int down, int hbd)
+{
+    int x;
+    for (x = 0; x < w; x++)
+        dst[x] = SAMPLE10(srcu, x >> shift_w) | SAMPLE10(srcy, x) << 10 | SAMPLE10(srcv, x >> shift_w) << 20 | 3u << 30;
+}
+
+static ALWAYS_INLINE void pack_y416_internal(uint16_t *dst, const uint8_t *srcy, const uint8_t *srcu, const uint8_t *srcv,
+                                             int w, int shift_w, int shift, int hbd)
+{
+    int x;
+    for (x = 0; x < w; x++)
+    {
+        dst[4 * x]     = SAMPLE(srcu, x >> shift_w) << shift;
+        dst[4 * x + 1] = SAMPLE(srcy, x) << shift;
+        dst[4 * x + 2] = SAMPLE(srcv, x >> shift_w) << shift;
+        dst[4 * x + 3] = 0xffff;
+    }
+}
+
+#undef SAMPLE10
+#undef SAMPLE
+
+#if HAVE_X86_INTRINSICS
+static TARGET("sse2") void chroma_vfilter_sse2(int16_t *dst, const uint8_t * const src[4], const int taps[4], int rounder, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i t01  = _mm_set1_epi32((taps[1] << 16) | (taps[0] & 0xffff));
+    const __m128i t23  = _mm_set1_epi32((taps[3] << 16) | (taps[2] & 0xffff));
+    const __m128i rnd  = _mm_set1_epi16(rounder);
+    int x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m128i s0 = _mm_slli_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src[0] + x)), zero), 7);
+        __m128i s1 = _mm_slli_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src[1] + x)), zero), 7);
+        __m128i s2 = _mm_slli_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src[2] + x)), zero), 7);
+        __m128i s3 = _mm_slli_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src[3] + x)), zero), 7);
+        __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(s0, s1), t01), _mm_madd_epi16(_mm_unpacklo_epi16(s2, s3), t23));
+        __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(s0, s1), t01), _mm_madd_epi16(_mm_unpackhi_epi16(s2, s3), t23));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_add_epi16(_mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16)), rnd));
+    }
+    chroma_vfilter_c_internal(dst, src, taps, rounder, x, w);
+}
+
+static TARGET("sse2") void yuv2bgra_sse2(uint8_t *dst, const uint8_t *srcy, const int16_t *srcu, const int16_t *srcv,
+                                         int w, const x264vfw_yuv2rgb_coeffs_t *c)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8(-1);
+    const __m128i c1024 = _mm_set1_epi16(128 << 3);
+    const __m128i yoff  = _mm_set1_epi16(c->y_offset);
+    const __m128i k_y   = _mm_set1_epi16(c->cy);
+    const __m128i k_r   = _mm_set1_epi16(c->crv);
+    const __m128i k_b   = _mm_set1_epi16(c->cbu);
+    const __m128i k_gu  = _mm_set1_epi16(-c->cgu);
+    const __m128i k_gv  = _mm_set1_epi16(-c->cgv);
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m128i y, y_lo, y_hi, u, v, cr, cg, cb, r, g, b, bg, ra;
+
+        /* Same pmulhw arithmetic as swscale, each term is rounded down on its own */
+        y = _mm_loadu_si128((const __m128i *)(srcy + x));
+        y_lo = _mm_mulhi_epi16(_mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(y, zero), 3), yoff), k_y);
+        y_hi = _mm_mulhi_epi16(_mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(y, zero), 3), yoff), k_y);
+        u = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(srcu + (x >> 1))), c1024);
+        v = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(srcv + (x >> 1))), c1024);
+        cr = _mm_mulhi_epi16(v, k_r);
+        cg = _mm_add_epi16(_mm_mulhi_epi16(u, k_gu), _mm_mulhi_epi16(v, k_gv));
+        cb = _mm_mulhi_epi16(u, k_b);
+
+        /* Each chroma sample covers two pixels */
+        r = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(cr, cr)), _mm_add_epi16(y_hi, _mm_unpackhi_epi16(cr, cr)));
+        g = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(cg, cg)), _mm_add_epi16(y_hi, _mm_unpackhi_epi16(cg, cg)));
+        b = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(cb, cb)), _mm_add_epi16(y_hi, _mm_unpackhi_epi16(cb, cb)));
+
+        bg = _mm_unpacklo_epi8(b, g);
+        ra = _mm_unpacklo_epi8(r, alpha);
+        _mm_storeu_si128((__m128i *)(dst + 4 * x),      _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(dst + 4 * x + 16), _mm_unpackhi_epi16(bg, ra));
+        bg = _mm_unpackhi_epi8(b, g);
+        ra = _mm_unpackhi_epi8(r, alpha);
+        _mm_storeu_si128((__m128i *)(dst + 4 * x + 32), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(dst + 4 * x + 48), _mm_unpackhi_epi16(bg, ra));
+    }
+    yuv2bgra_c_internal(dst, srcy, srcu, srcv, x, w, c);
+}
+
+static TARGET("ssse3") void bgra_to_bgr_ssse3(uint8_t *dst, const uint8_t *src, int w)
+{
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m128i s0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 4 * x)),      shuf);
+        __m128i s1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 4 * x + 16)), shuf);
+        __m128i s2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 4 * x + 32)), shuf);
+        __m128i s3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 4 * x + 48)), shuf);
+        _mm_storeu_si128((__m128i *)(dst + 3 * x),      _mm_or_si128(s0, _mm_slli_si128(s1, 12)));
+        _mm_storeu_si128((__m128i *)(dst + 3 * x + 16), _mm_or_si128(_mm_srli_si128(s1, 4), _mm_slli_si128(s2, 8)));
+        _mm_storeu_si128((__m128i *)(dst + 3 * x + 32), _mm_or_si128(_mm_srli_si128(s2, 8), _mm_slli_si128(s3, 4)));
+    }
+    bgra_to_bgr_c(dst + 3 * x, src + 4 * x, w - x);
+}
+
+static TARGET("sse2") void shl16_sse2(uint16_t *dst, const uint16_t *src, int w, int shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + x + 8));
+        _mm_storeu_si128((__m128i *)(dst + x),     _mm_sll_epi16(a, count));
+        _mm_storeu_si128((__m128i *)(dst + x + 8), _mm_sll_epi16(b, count));
+    }
+    shl16_c(dst + x, src + x, w - x, shift);
+}
+
+static TARGET("sse2") void interleave_shl16_sse2(uint16_t *dst, const uint16_t *srcu, const uint16_t *srcv, int w, int shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m128i u = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(srcu + x)), count);
+        __m128i v = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(srcv + x)), count);
+        _mm_storeu_si128((__m128i *)(dst + 2 * x),     _mm_unpacklo_epi16(u, v));
+        _mm_storeu_si128((__m128i *)(dst + 2 * x + 8), _mm_unpackhi_epi16(u, v));
+    }
+    interleave_shl16_c(dst + 2 * x, srcu + x, srcv + x, w - x, shift);
+}
+
+static TARGET("sse2") void dither_sse2(uint8_t *dst, const uint16_t *src, int w, const uint16_t dither[8], int shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m128i d = _mm_loadu_si128((const __m128i *)dither);
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m128i a = _mm_srl_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i *)(src + x)), d), count);
+        __m128i b = _mm_srl_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i *)(src + x + 8)), d), count);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(a, b));
+    }
+    dither_c(dst + x, src + x, w - x, dither, shift);
+}
+
+static TARGET("sse2") void dither_interleave_sse2(uint8_t *dst, const uint16_t *srcu, const uint16_t *srcv, int w,
+                                                  const uint16_t dither[8], int shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m128i d = _mm_loadu_si128((const __m128i *)dither);
+    int x;
+
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m128i u = _mm_srl_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i *)(srcu + x)), d), count);
+        __m128i v = _mm_srl_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i *)(srcv + x)), d), count);
+        _mm_storeu_si128((__m128i *)(dst + 2 * x), _mm_packus_epi16(_mm_unpacklo_epi16(u, v), _mm_unpackhi_epi16(u, v)));
+    }
+    dither_interleave_c(dst + 2 * x, srcu + x, srcv + x, w - x, dither, shift);
+}
+
+static TARGET("avx2") void chroma_vfilter_avx2(int16_t *dst, const uint8_t * const src[4], const int taps[4], int rounder, int w)
+{
+    const __m256i t01 = _mm256_set1_epi32((taps[1] << 16) | (taps[0] & 0xffff));
+    const __m256i t23 = _mm256_set1_epi32((taps[3] << 16) | (taps[2] & 0xffff));
+    const __m256i rnd = _mm256_set1_epi16(rounder);
+    int x;
+
+    for (x = 0; x + 16 <= w; x += 16)
+    {
+        __m256i s0 = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src[0] + x))), 7);
+        __m256i s1 = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src[1] + x))), 7);
+        __m256i s2 = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src[2] + x))), 7);
+        __m256i s3 = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src[3] + x))), 7);
+        /* packs undoes the per-lane unpack */
+        __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(s0, s1), t01),
+                                      _mm256_madd_epi16(_mm256_unpacklo_epi16(s2, s3), t23));
+        __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(s0, s1), t01),
+                                      _mm256_madd_epi16(_mm256_unpackhi_epi16(s2, s3), t23));
+        _mm256_storeu_si256((__m256i *)(dst + x),
+                            _mm256_add_epi16(_mm256_packs_epi32(_mm256_srai_epi32(lo, 16), _mm256_srai_epi32(hi, 16)), rnd));
+    }
+    chroma_vfilter_c_internal(dst, src, taps, rounder, x, w);
+}
+
+static TARGET("avx2") void yuv2bgra_avx2(uint8_t *dst, const uint8_t *srcy, const int16_t *srcu, const int16_t *srcv,
+                                         int w, const x264vfw_yuv2rgb_coeffs_t *c)
+{
+    const __m256i alpha = _mm256_set1_epi8(-1);
+    const __m256i c1024 = _mm256_set1_epi16(128 << 3);
+    const __m256i yoff  = _mm256_set1_epi16(c->y_offset);
+    const __m256i k_y   = _mm256_set1_epi16(c->cy);
+    const __m256i k_r   = _mm256_set1_epi16(c->crv);
+    const __m256i k_b   = _mm256_set1_epi16(c->cbu);
+    const __m256i k_gu  = _mm256_set1_epi16(-c->cgu);
+    const __m256i k_gv  = _mm256_set1_epi16(-c->cgv);
+    int x;
+
+    for (x = 0; x + 32 <= w; x += 32)
+    {
+        __m256i y_lo, y_hi, u, v, cr, cg, cb, r, g, b, bg, ra, t0, t1;
+
+        y_lo = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(srcy + x))), 3);
+        y_hi = _mm256_slli_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(srcy + x + 16))), 3);
+        y_lo = _mm256_mulhi_epi16(_mm256_sub_epi16(y_lo, yoff), k_y);
+        y_hi = _mm256_mulhi_epi16(_mm256_sub_epi16(y_hi, yoff), k_y);
+        u = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(srcu + (x >> 1))), c1024);
+        v = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(srcv + (x >> 1))), c1024);
+        cr = _mm256_mulhi_epi16(v, k_r);
+        cg = _mm256_add_epi16(_mm256_mulhi_epi16(u, k_gu), _mm256_mulhi_epi16(v, k_gv));
+        cb = _mm256_mulhi_epi16(u, k_b);
+
+        /* Each chroma sample covers two pixels, the per-lane unpack is put back in order to match y_lo/y_hi */
+#define CHROMA_ADD(d, c)\
+        t0 = _mm256_unpacklo_epi16(c, c);\
+        t1 = _mm256_unpackhi_epi16(c, c);\
+        d = _mm256_packus_epi16(_mm256_add_epi16(y_lo, _mm256_permute2x128_si256(t0, t1, 0x20)),\
+                                _mm256_add_epi16(y_hi, _mm256_permute2x128_si256(t0, t1, 0x31)));
+        CHROMA_ADD(r, cr);
+        CHROMA_ADD(g, cg);
+        CHROMA_ADD(b, cb);
+#undef CHROMA_ADD
+        /* Lane 0 holds pixels 0-7 and 16-23, lane 1 holds pixels 8-15 and 24-31 */
+        bg = _mm256_unpacklo_epi8(b, g);
+        ra = _mm256_unpacklo_epi8(r, alpha);
+        t0 = _mm256_unpacklo_epi16(bg, ra);
+        t1 = _mm256_unpackhi_epi16(bg, ra);
+        _mm256_storeu_si256((__m256i *)(dst + 4 * x),      _mm256_permute2x128_si256(t0, t1, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * x + 32), _mm256_permute2x128_si256(t0, t1, 0x31));
+        bg = _mm256_unpackhi_epi8(b, g);
+        ra = _mm256_unpackhi_epi8(r, alpha);
+        t0 = _mm256_unpacklo_epi16(bg, ra);
+        t1 = _mm256_unpackhi_epi16(bg, ra);
+        _mm256_storeu_si256((__m256i *)(dst + 4 * x + 64), _mm256_permute2x128_si256(t0, t1, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * x + 96), _mm256_permute2x128_si256(t0, t1, 0x31));
+    }
+    yuv2bgra_c_internal(dst, srcy, srcu, srcv, x, w, c);
+}
+
+static TARGET("avx2") void dither_avx2(uint8_t *dst, const uint16_t *src, int w, const uint16_t dither[8], int shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m256i d = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)dither));
+    int x;
+
+    for (x = 0; x + 32 <= w; x += 32)
+    {
+        __m256i a = _mm256_srl_epi16(_mm256_adds_epu16(_mm256_loadu_si256((const __m256i *)(src + x)), d), count);
+        __m256i b = _mm256_srl_epi16(_mm256_adds_epu16(_mm256_loadu_si256((const __m256i *)(src + x + 16)), d), count);
+        /* packus works within the lanes */
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+    }
+    dither_sse2(dst + x, src + x, w - x, dither, shift);
+}
+
+/* 32-bit gathers of the 16-bit and 8-bit tables, the tables are padded for the bytes read past the last entry */
+static ALWAYS_INLINE TARGET("avx2") void yuv2bgra_tonemap_avx2_internal(uint8_t *dst, const uint16_t *srcy, const uint16_t *srcu, const uint16_t *srcv,
+                                                                        int w, int shift, const x264vfw_tonemap_t *tm)
+{
+    const __m256i y_offset = _mm256_set1_epi32(tm->y_offset);
+    const __m256i c_offset = _mm256_set1_epi32(tm->c_offset);
+    const __m256i cy       = _mm256_set1_epi32(tm->cy);
+    const __m256i crv      = _mm256_set1_epi32(tm->crv);
+    const __m256i cbu      = _mm256_set1_epi32(tm->cbu);
+    const __m256i cgu      = _mm256_set1_epi32(tm->cgu);
+    const __m256i cgv      = _mm256_set1_epi32(tm->cgv);
+    const __m256i round16  = _mm256_set1_epi32(1 << 15);
+    const __m256i round14  = _mm256_set1_epi32(1 << 13);
+    const __m256i zero     = _mm256_setzero_si256();
+    const __m256i max10    = _mm256_set1_epi32(1023);
+    const __m256i max16    = _mm256_set1_epi32(65535);
+    const __m256i mask8    = _mm256_set1_epi32(0xff);
+    const __m256i alpha    = _mm256_set1_epi32(0xff000000);
+    const int *eotf = (const int *)tm->eotf;
+    const int *oetf = (const int *)tm->oetf;
+    __m256i m[9];
+    int x, i;
+
+    for (i = 0; i < 9; i++)
+        m[i] = _mm256_set1_epi32(tm->gamut[i]);
+
+#define EOTF(c) _mm256_and_si256(_mm256_i32gather_epi32(eotf, _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(c, 16), zero), max10), 2), max16)
+#define GAMUT(k, r, g, b) _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(_mm256_add_epi32(\
+    _mm256_add_epi32(_mm256_mullo_epi32(r, m[k]), _mm256_mullo_epi32(g, m[k + 1])),\
+    _mm256_add_epi32(_mm256_mullo_epi32(b, m[k + 2]), round14)), 14), zero), max16)
+#define OETF(c) _mm256_and_si256(_mm256_i32gather_epi32(oetf, c, 1), mask8)
+    for (x = 0; x + 8 <= w; x += 8)
+    {
+        __m256i y = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(srcy + x)));
+        __m256i u, v, r, g, b, r2, g2, b2;
+
+        if (shift)
+        {
+            __m128i u4 = _mm_loadl_epi64((const __m128i *)(srcu + (x >> 1)));
+            __m128i v4 = _mm_loadl_epi64((const __m128i *)(srcv + (x >> 1)));
+            u = _mm256_cvtepu16_epi32(_mm_unpacklo_epi16(u4, u4));
+            v = _mm256_cvtepu16_epi32(_mm_unpacklo_epi16(v4, v4));
+        }
+        else
+        {
+            u = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(srcu + x)));
+            v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(srcv + x)));
+        }
+        y = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(y, y_offset), cy), round16);
+        u = _mm256_sub_epi32(u, c_offset);
+        v = _mm256_sub_epi32(v, c_offset);
+
+        r = EOTF(_mm256_add_epi32(y, _mm256_mullo_epi32(v, crv)));
+        g = EOTF(_mm256_sub_epi32(_mm256_sub_epi32(y, _mm256_mullo_epi32(u, cgu)), _mm256_mullo_epi32(v, cgv)));
+        b = EOTF(_mm256_add_epi32(y, _mm256_mullo_epi32(u, cbu)));
+        r2 = OETF(GAMUT(0, r, g, b));
+        g2 = OETF(GAMUT(3, r, g, b));
+        b2 = OETF(GAMUT(6, r, g, b));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * x),
+                            _mm256_or_si256(_mm256_or_si256(b2, _mm256_slli_epi32(g2, 8)),
+                                            _mm256_or_si256(_mm256_slli_epi32(r2, 16), alpha)));
+    }
+#undef EOTF
+#undef GAMUT
+#undef OETF
+    yuv2bgra_tonemap_c_internal(dst, srcy, srcu, srcv, x, w, shift, tm);
+}
+
+static TARGET("avx2") void yuv444_to_bgra_tonemap_avx2(uint8_t *dst, const uint16_t *srcy, const uint16_t *srcu, const uint16_t *srcv,
+                                                       int w, const x264vfw_tonemap_t *tm)
+{
+    yuv2bgra_tonemap_avx2_internal(dst, srcy, srcu, srcv, w, 0, tm);
+}
+
+static TARGET("avx2") void yuv422_to_bgra_tonemap_avx2(uint8_t *dst, const uint16_t *srcy, const uint16_t *srcu, const uint16_t *srcv,
+                                                       int w, const x264vfw_tonemap_t *tm)
+{
+    yuv2bgra_tonemap_avx2_internal(dst, srcy, srcu, srcv, w, 1, tm);
+}
+#endif
+
+void x264vfw_csp_init(uint32_t cpu, x264vfw_csp_function_t *pf)
+{
+    pf->chroma_vfilter = chroma_vfilter_c;
+    pf->yuv2bgra = yuv2bgra_c;
+    pf->bgra2bgr = bgra_to_bgr_c;
+    pf->shl16 = shl16_c;
+    pf->interleave_shl16 = interleave_shl16_c;
+    pf->dither = dither_c;
+    pf->dither_interleave = dither_interleave_c;
+    pf->yuv2bgra_tonemap[0] = yuv444_to_bgra_tonemap_c;
+    pf->yuv2bgra_tonemap[1] = yuv422_to_bgra_tonemap_c;
+#if HAVE_X86_INTRINSICS
+    if (cpu & X264VFW_CPU_SSE2)
+    {
+        pf->chroma_vfilter = chroma_vfilter_sse2;
+        pf->yuv2bgra = yuv2bgra_sse2;
+        pf->shl16 = shl16_sse2;
+        pf->interleave_shl16 = interleave_shl16_sse2;
+        pf->dither = dither_sse2;
+        pf->dither_interleave = dither_interleave_sse2;
+    }
+    if (cpu & X264VFW_CPU_SSSE3)
+        pf->bgra2bgr = bgra_to_bgr_ssse3;
+    if (cpu & X264VFW_CPU_AVX2)
+    {
+        pf->chroma_vfilter = chroma_vfilter_avx2;
+        pf->yuv2bgra = yuv2bgra_avx2;
+        pf->dither = dither_avx2;
+        pf->yuv2bgra_tonemap[0] = yuv444_to_bgra_tonemap_avx2;
+        pf->yuv2bgra_tonemap[1] = yuv422_to_bgra_tonemap_avx2;
+    }
+#endif
+}
+
+void x264vfw_yuv2rgb(const x264vfw_csp_function_t *pf, const x264vfw_yuv2rgb_coeffs_t *c, int bgr24,
+                     uint8_t *dst, intptr_t i_dst, uint8_t * const src[3], const int i_src[3],
+                     int chroma_shift_h, int w, int h, int y_start, int y_end)
+{
+    /* The filtered chroma and BGR24 go through small buffers which stay in L1 */
+    int16_t u[128], v[128];
+    uint8_t tmp[256 * 4];
+    int y;
+
+    for (y = y_start; y < y_end; y++)
+    {
+        const uint8_t *srcy = src[0] + (intptr_t)y * i_src[0];
+        const uint8_t *srcu[4], *srcv[4];
+        uint8_t *dst_row = dst + (intptr_t)y * i_dst;
+        int rows[4], taps[4], rounder, i, x, n;
+
+        rounder = yuv2rgb_chroma_taps(c, chroma_shift_h, y, h, rows, taps);
+        for (i = 0; i < 4; i++)
+        {
+            srcu[i] = src[1] + (intptr_t)rows[i] * i_src[1];
+            srcv[i] = src[2] + (intptr_t)rows[i] * i_src[2];
+        }
+        for (x = 0; x < w; x += n)
+        {
+            const uint8_t *chroma[4];
+
+            n = X264VFW_MIN(w - x, 256);
+            for (i = 0; i < 4; i++)
+                chroma[i] = srcu[i] + (x >> 1);
+            pf->chroma_vfilter(u, chroma, taps, rounder, (n + 1) >> 1);
+            for (i = 0; i < 4; i++)
+                chroma[i] = srcv[i] + (x >> 1);
+            pf->chroma_vfilter(v, chroma, taps, rounder, (n + 1) >> 1);
+            if (!bgr24)
+                pf->yuv2bgra(dst_row + 4 * x, srcy + x, u, v, n, c);
+            else
+            {
+                pf->yuv2bgra(tmp, srcy + x, u, v, n, c);
+                pf->bgra2bgr(dst_row + 3 * x, tmp, n);
+            }
+        }
+    }
+}
+
+void x264vfw_yuv2rgb_tonemap(const x264vfw_csp_function_t *pf, const x264vfw_tonemap_t *tm, int bgr24,
+                             uint8_t *dst, intptr_t i_dst, uint8_t * const src[3], const int i_src[3],
+                             int chroma_shift_w, int chroma_shift_h, int w, int y_start, int y_end)
+{
+    uint8_t tmp[256 * 4];
+    int y;
+
+    for (y = y_start; y < y_end; y++)
+    {
+        const uint16_t *srcy = (const uint16_t *)(src[0] + (intptr_t)y * i_src[0]);
+        const uint16_t *srcu = (const uint16_t *)(src[1] + (intptr_t)(y >> chroma_shift_h) * i_src[1]);
+        const uint16_t *srcv = (const uint16_t *)(src[2] + (intptr_t)(y >> chroma_shift_h) * i_src[2]);
+        uint8_t *dst_row = dst + (intptr_t)y * i_dst;
+
+        if (!bgr24)
+            pf->yuv2bgra_tonemap[chroma_shift_w](dst_row, srcy, srcu, srcv, w, tm);
+        else
+        {
+            int x, n;
+            for (x = 0; x < w; x += n)
+            {
+                n = X264VFW_MIN(w - x, 256);
+                pf->yuv2bgra_tonemap[chroma_shift_w](tmp, srcy + x, srcu + (x >> chroma_shift_w), srcv + (x >> chroma_shift_w), n, tm);
+                pf->bgra2bgr(dst_row + 3 * x, tmp, n);
+            }
+        }
+    }
+}
+
+void x264vfw_yuv2hbd(const x264vfw_csp_function_t *pf, int csp, uint8_t * const dst[2], const int i_dst[2],
+                     uint8_t * const src[3], const int i_src[3], int depth,
+                     int chroma_shift_w, int chroma_shift_h, int w, int y_start, int y_end)
+{
+    int hbd = depth > 8;
+    int up = X264VFW_MAX(10 - depth, 0);
+    int down = X264VFW_MAX(depth - 10, 0);
+    int y;
+
+    if (csp == X264VFW_CSP_P010 || csp == X264VFW_CSP_P016)
+    {
+        /* Both keep the samples in the msbs, so it is the same for 10-bit input */
+        int chroma_w = (w + 1) >> 1;
+        for (y = y_start; y < y_end; y++)
+            pf->shl16((uint16_t *)(dst[0] + (intptr_t)y * i_dst[0]), (const uint16_t *)(src[0] + (intptr_t)y * i_src[0]),
+                      w, 16 - depth);
+        for (y = y_start >> 1; y < (y_end + 1) >> 1; y++)
+            pf->interleave_shl16((uint16_t *)(dst[1] + (intptr_t)y * i_dst[1]),
+                                 (const uint16_t *)(src[1] + (intptr_t)y * i_src[1]),
+                                 (const uint16_t *)(src[2] + (intptr_t)y * i_src[2]), chroma_w, 16 - depth);
+        return;
+    }
+
+    for (y = y_start; y < y_end; y++)
+    {
+        const uint8_t *srcy = src[0] + (intptr_t)y * i_src[0];
+        const uint8_t *srcu = src[1] + (intptr_t)(y >> chroma_shift_h) * i_src[1];
+        const uint8_t *srcv = src[2] + (intptr_t)(y >> chroma_shift_h) * i_src[2];
+        uint8_t *dst_row = dst[0] + (intptr_t)y * i_dst[0];
+
+        switch (csp)
+        {
+            case X264VFW_CSP_V210:
+                /* 4:4:4 gives every other chroma sample */
+                if (hbd)
+                    pack_v210_internal((uint32_t *)dst_row, srcy, srcu, srcv, w, chroma_shift_w, up, down, 1);
+                else
+                    pack_v210_internal((uint32_t *)dst_row, srcy, srcu, srcv, w, chroma_shift_w, up, down, 0);
+                break;
+
+            case X264VFW_CSP_Y410:
+                if (hbd)
+                    pack_y410_internal((uint32_t *)dst_row, srcy, srcu, srcv, w, chroma_shift_w, up, down, 1);
+                else
+                    pack_y410_internal((uint32_t *)dst_row, srcy, srcu, srcv, w, chroma_shift_w, up, down, 0);
+                break;
+
+            case X264VFW_CSP_Y416:
+                if (hbd)
+                    pack_y416_internal((uint16_t *)dst_row, srcy, srcu, srcv, w, chroma_shift_w, 16 - depth, 1);
+                else
+                    pack_y416_internal((uint16_t *)dst_row, srcy, srcu, srcv, w, chroma_shift_w, 16 - depth, 0);
+                break;
+
+            default:
+                return;
+        }
+    }
+}
+
+/* Thresholds of row y scaled to [0, 2^shift) */
+static void dither_row_init(uint16_t dither[8], int y, int shift)
+{
+    int x;
+    for (x = 0; x < 8; x++)
+        dither[x] = (dither_8x8[y & 7][x] << shift) >> 6;
+}
+
+void x264vfw_yuv_dither(const x264vfw_csp_function_t *pf, uint8_t * const dst[3], const int i_dst[3],
+                        uint8_t * const src[3], const int i_src[3], int depth, int nv12,
+                        int chroma_shift_w, int chroma_shift_h, int w, int y_start, int y_end)
+{
+    int shift = depth - 8;
+    int chroma_w = (w + (1 << chroma_shift_w) - 1) >> chroma_shift_w;
+    int chroma_start = y_start >> chroma_shift_h;
+    int chroma_end = (y_end + (1 << chroma_shift_h) - 1) >> chroma_shift_h;
+    uint16_t dither[8];
+    int y;
+
+    for (y = y_start; y < y_end; y++)
+    {
+        dither_row_init(dither, y, shift);
+        pf->dither(dst[0] + (intptr_t)y * i_dst[0], (const uint16_t *)(src[0] + (intptr_t)y * i_src[0]), w, dither, shift);
+    }
+    for (y = chroma_start; y < chroma_end; y++)
+    {
+        const uint16_t *srcu = (const uint16_t *)(src[1] + (intptr_t)y * i_src[1]);
+        const uint16_t *srcv = (const uint16_t *)(src[2] + (intptr_t)y * i_src[2]);
+
+        /* Another phase than the luma so the patterns don't line up */
+        dither_row_init(dither, y + 4, shift);
+        if (nv12)
+            pf->dither_interleave(dst[1] + (intptr_t)y * i_dst[1], srcu, srcv, chroma_w, dither, shift);
+        else
+        {
+            pf->dither(dst[1] + (intptr_t)y * i_dst[1], srcu, chroma_w, dither, shift);
+            pf->dither(dst[2] + (intptr_t)y * i_dst[2], srcv, chroma_w, dither, shift);
+        }
+    }
+}
+
+void x264vfw_plane_copy(uint8_t *dst, intptr_t i_dst, const uint8_t *src, intptr_t i_src, int w, int h)
+{
+    if (i_dst == i_src && i_dst == w)
+    {
+        memcpy(dst, src, (size_t)w * h);
+        return;
+    }
+    for (; h > 0; h--)
+    {
+        memcpy(dst, src, w);
+        dst += i_dst;
+        src += i_src;
+    }
+}
+
+void x264vfw_plane_copy_interleave(uint8_t *dst, intptr_t i_dst,
+                                   const uint8_t *srcu, intptr_t i_srcu,
+                                   const uint8_t *srcv, intptr_t i_srcv, int w, int h)
+{
+    for (; h > 0; h--)
+    {
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 16 <= w; x += 16)
+        {
+            __m128i u = _mm_loadu_si128((const __m128i *)(srcu + x));
+            __m128i v = _mm_loadu_si128((const __m128i *)(srcv + x));
+            _mm_storeu_si128((__m128i *)(dst + 2 * x),      _mm_unpacklo_epi8(u, v));
+            _mm_storeu_si128((__m128i *)(dst + 2 * x + 16), _mm_unpackhi_epi8(u, v));
+        }
+#endif
+        for (; x < w; x++)
+        {
+            dst[2 * x]     = srcu[x];
+            dst[2 * x + 1] = srcv[x];
+        }
+        dst += i_dst;
+        srcu += i_srcu;
+        srcv += i_srcv;
+    }
+}
@@ -40,7 +40,114 @@
 #define X264VFW_CSP_UYVY           0x0007  /* yuv 4:2:2 packed */
 #define X264VFW_CSP_BGR            0x0008  /* packed bgr 24bits */
 #define X264VFW_CSP_BGRA           0x0009  /* packed bgr 32bits */
-//#define X264VFW_CSP_MAX          0x000a  /* end of list */
+#define X264VFW_CSP_P010           0x000a  /* yuv 4:2:0 16-bit, with one y plane and one packed u+v, 10 bits in the msbs */
+#define X264VFW_CSP_P016           0x000b  /* same layout as P010, all 16 bits significant */
+#define X264VFW_CSP_V210           0x000c  /* yuv 4:2:2 10-bit packed, 6 pixels in 4 dwords, rows aligned to 128 bytes */
+#define X264VFW_CSP_Y410           0x000d  /* yuv 4:4:4 10-bit packed, u | y << 10 | v << 20 | a << 30 */
+#define X264VFW_CSP_Y416           0x000e  /* yuv 4:4:4 16-bit packed, u y v a */
+//#define X264VFW_CSP_MAX          0x000f  /* end of list */
 #define X264VFW_CSP_VFLIP          0x1000  /* the csp is vertically flipped */
 
+/* YUV -> RGB conversion as the SIMD output of swscale: the samples are scaled by 8, each product with a
+ * coefficient (13-bit fixed point) is taken >> 16 on its own */
+typedef struct
+{
+    int y_offset;   /* black level scaled by 8, less the rounder of the bicubic output */
+    int cy;
+    int crv;
+    int cbu;
+    int cgu;
+    int cgv;
+    int filter;     /* vertical chroma filter of 4:2:0, X264VFW_QUALITY_* */
+} x264vfw_yuv2rgb_coeffs_t;
+
+/* HDR transfer functions */
+#define X264VFW_TONEMAP_PQ  1 /* SMPTE ST 2084 */
+#define X264VFW_TONEMAP_HLG 2 /* ARIB STD-B67 */
+
+/* HDR YUV -> SDR BGRA tables: R'G'B' of 10 bits -> tone mapped linear light -> BT.709 primaries -> BT.709 OETF */
+typedef struct
+{
+    /* What the tables were built for */
+    int      transfer;      /* X264VFW_TONEMAP_* */
+    int      bt2020;        /* BT.2020 primaries, else they are left as they are */
+    int      depth;
+    int      full_range;
+    int      peak;
+    /* YUV -> R'G'B' of 10 bits (16.16 fixed point), BT.2020 non-constant luminance */
+    int      y_offset;
+    int      c_offset;
+    int      cy;
+    int      crv;
+    int      cbu;
+    int      cgu;
+    int      cgv;
+    int      gamut[9];      /* linear light BT.2020 -> BT.709, 2.14 fixed point */
+    uint16_t eotf[1024 + 2];  /* R'G'B' -> linear light of 16 bits, 65535 is the SDR peak. Padded for 32-bit gathers */
+    uint8_t  oetf[65536 + 4]; /* linear light -> BT.709 */
+} x264vfw_tonemap_t;
+
+typedef struct
+{
+    /* Filter 4 chroma rows into one of samples scaled by 8: (sum(taps[i] * (src[i][x] << 7)) >> 16) + rounder */
+    void (*chroma_vfilter)(int16_t *dst, const uint8_t * const src[4], const int taps[4], int rounder, int w);
+    /* Convert one row to BGRA from chroma of half width filtered by chroma_vfilter */
+    void (*yuv2bgra)(uint8_t *dst, const uint8_t *srcy, const int16_t *srcu, const int16_t *srcv,
+                     int w, const x264vfw_yuv2rgb_coeffs_t *c);
+    /* Drop the alpha channel of one row */
+    void (*bgra2bgr)(uint8_t *dst, const uint8_t *src, int w);
+    /* Shift one row of 16-bit samples into the msbs, interleaving two rows for the chroma (P010/P016) */
+    void (*shl16)(uint16_t *dst, const uint16_t *src, int w, int shift);
+    void (*interleave_shl16)(uint16_t *dst, const uint16_t *srcu, const uint16_t *srcv, int w, int shift);
+    /* Reduce one row of 16-bit samples to 8 bits: (src + dither[x & 7]) >> shift, saturated */
+    void (*dither)(uint8_t *dst, const uint16_t *src, int w, const uint16_t dither[8], int shift);
+    void (*dither_interleave)(uint8_t *dst, const uint16_t *srcu, const uint16_t *srcv, int w,
+                              const uint16_t dither[8], int shift);
+    /* Convert one row of HDR YUV of 9 to 16 bits to SDR BGRA, [0] - full chroma width, [1] - half chroma width */
+    void (*yuv2bgra_tonemap[2])(uint8_t *dst, const uint16_t *srcy, const uint16_t *srcu, const uint16_t *srcv,
+                                int w, const x264vfw_tonemap_t *tm);
+} x264vfw_csp_function_t;
+
+void x264vfw_csp_init(uint32_t cpu, x264vfw_csp_function_t *pf);
+
+/* inv_table is the swscale coefficient table ({crv, cbu, cgu, cgv}, 16.16 for limited range chroma).
+ * quality (X264VFW_QUALITY_*) picks the vertical chroma filter swscale has with the flags of that quality */
+void x264vfw_yuv2rgb_init(x264vfw_yuv2rgb_coeffs_t *c, const int *inv_table, int full_range,
+                          int quality, int chroma_shift_h);
+
+/* Convert rows [y_start, y_end) of planar 4:2:0 or 4:2:2 YUV of height h to BGRA or BGR24 as swscale does
+ * (up to its last two rows, which it converts with its C code). dst/i_dst describe the whole picture
+ * so a negative i_dst gives a vertically flipped output */
+void x264vfw_yuv2rgb(const x264vfw_csp_function_t *pf, const x264vfw_yuv2rgb_coeffs_t *c, int bgr24,
+                     uint8_t *dst, intptr_t i_dst, uint8_t * const src[3], const int i_src[3],
+                     int chroma_shift_h, int w, int h, int y_start, int y_end);
+
+/* Build the tone mapping tables for the transfer (X264VFW_TONEMAP_*) of YUV with depth bits per sample (9 to 16).
+ * peak is the brightest light of PQ in nits. Nothing is done if they are built for the same parameters */
+void x264vfw_tonemap_init(x264vfw_tonemap_t *tm, int transfer, int bt2020, int depth, int full_range, int peak);
+
+/* Convert rows [y_start, y_end) of planar HDR YUV to SDR BGRA or BGR24 in one pass, as x264vfw_yuv2rgb */
+void x264vfw_yuv2rgb_tonemap(const x264vfw_csp_function_t *pf, const x264vfw_tonemap_t *tm, int bgr24,
+                             uint8_t *dst, intptr_t i_dst, uint8_t * const src[3], const int i_src[3],
+                             int chroma_shift_w, int chroma_shift_h, int w, int y_start, int y_end);
+
+/* Convert rows [y_start, y_end) of planar YUV with depth bits per sample (8 to 16) to X264VFW_CSP_P010,
+ * P016, V210, Y410 or Y416. dst/i_dst are the planes of the whole picture. The chroma is repeated or
+ * dropped to fit the subsampling of the output, P010/P016 need 4:2:0 with more than 8 bits */
+void x264vfw_yuv2hbd(const x264vfw_csp_function_t *pf, int csp, uint8_t * const dst[2], const int i_dst[2],
+                     uint8_t * const src[3], const int i_src[3], int depth,
+                     int chroma_shift_w, int chroma_shift_h, int w, int y_start, int y_end);
+
+/* Convert rows [y_start, y_end) of planar YUV with depth bits per sample (9 to 16) to 8-bit planar YUV
+ * of the same subsampling in one pass, with an 8x8 ordered dither. nv12 interleaves the chroma into dst[1] */
+void x264vfw_yuv_dither(const x264vfw_csp_function_t *pf, uint8_t * const dst[3], const int i_dst[3],
+                        uint8_t * const src[3], const int i_src[3], int depth, int nv12,
+                        int chroma_shift_w, int chroma_shift_h, int w, int y_start, int y_end);
+
+/* Plane copy functions */
+void x264vfw_plane_copy(uint8_t *dst, intptr_t i_dst, const uint8_t *src, intptr_t i_src, int w, int h);
+void x264vfw_plane_copy_interleave(uint8_t *dst, intptr_t i_dst,
+                                   const uint8_t *srcu, intptr_t i_srcu,
+                                   const uint8_t *srcv, intptr_t i_srcv, int w, int h);
+
 #endif
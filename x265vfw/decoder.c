@@ -0,0 +1,1818 @@
+/*****************************************************************************
+ * decoder.c: VFW independent decoding pipeline
+ *****************************************************************************
+ * Copyright (C) 2003-2016 x265vfw project
+ *
+ * Authors: Justin Clay
+ *          Laurent Aimar <fenrir@via.ecp.fr>
+ *          Anton Mitrofanov <BugMaster@narod.ru>
+ *          Attila Padar <mpxplay@freemail.hu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "decoder.h"
+
+#include <limits.h>
+
+#include <libavutil/pixdesc.h>
+
+#define X264VFW_EVENT_ERROR(codec) X264VFW_EVENT((codec)->events, X264VFW_EV_ERROR, X264VFW_EV_INSTANT, __LINE__)
+
+enum AVPixelFormat x264vfw_csp_to_pix_fmt(int i_csp)
+{
+    i_csp &= X264VFW_CSP_MASK;
+    switch (i_csp)
+    {
+        case X264VFW_CSP_I420:
+        case X264VFW_CSP_YV12:
+            return AV_PIX_FMT_YUV420P;
+
+        //case X264VFW_CSP_I422:
+        case X264VFW_CSP_YV16:
+            return AV_PIX_FMT_YUV422P;
+
+        //case X264VFW_CSP_I444:
+        case X264VFW_CSP_YV24:
+            return AV_PIX_FMT_YUV444P;
+
+        case X264VFW_CSP_NV12:
+            return AV_PIX_FMT_NV12;
+
+        case X264VFW_CSP_YUYV:
+            return AV_PIX_FMT_YUYV422;
+
+        case X264VFW_CSP_UYVY:
+            return AV_PIX_FMT_UYVY422;
+
+        case X264VFW_CSP_BGR:
+            return AV_PIX_FMT_BGR24;
+
+        case X264VFW_CSP_BGRA:
+            return AV_PIX_FMT_BGRA;
+
+        /* P016 is written like P010, 10-bit samples shifted into the msbs */
+        case X264VFW_CSP_P010:
+        case X264VFW_CSP_P016:
+            return AV_PIX_FMT_P010LE;
+
+        case X264VFW_CSP_V210:
+            return X264VFW_PIX_FMT_V210;
+
+        case X264VFW_CSP_Y410:
+            return X264VFW_PIX_FMT_Y410;
+
+        case X264VFW_CSP_Y416:
+            return X264VFW_PIX_FMT_Y416;
+
+        default:
+            return AV_PIX_FMT_NONE;
+    }
+}
+
+static int x264vfw_picture_fill(AVPicture *picture, uint8_t *ptr, enum AVPixelFormat pix_fmt, int width, int height)
+{
+    memset(picture, 0, sizeof(AVPicture));
+
+    switch ((int)pix_fmt)
+    {
+        case AV_PIX_FMT_YUV420P:
+        {
+            int size, size2;
+            height = (height + 1) & ~1;
+            width = (width + 1) & ~1;
+            picture->linesize[0] = width;
+            picture->linesize[1] =
+            picture->linesize[2] = width / 2;
+            size  = picture->linesize[0] * height;
+            size2 = picture->linesize[1] * height / 2;
+            picture->data[0] = ptr;
+            picture->data[1] = picture->data[0] + size;
+            picture->data[2] = picture->data[1] + size2;
+            return size + 2 * size2;
+        }
+
+        case AV_PIX_FMT_YUV422P:
+        {
+            int size, size2;
+            width = (width + 1) & ~1;
+            picture->linesize[0] = width;
+            picture->linesize[1] =
+            picture->linesize[2] = width / 2;
+            size  = picture->linesize[0] * height;
+            size2 = picture->linesize[1] * height;
+            picture->data[0] = ptr;
+            picture->data[1] = picture->data[0] + size;
+            picture->data[2] = picture->data[1] + size2;
+            return size + 2 * size2;
+        }
+
+        case AV_PIX_FMT_YUV444P:
+        {
+            int size;
+            picture->linesize[0] =
+            picture->linesize[1] =
+            picture->linesize[2] = width;
+            size  = picture->linesize[0] * height;
+            picture->data[0] = ptr;
+            picture->data[1] = picture->data[0] + size;
+            picture->data[2] = picture->data[1] + size;
+            return 3 * size;
+        }
+
+        case AV_PIX_FMT_NV12:
+        {
+            int size;
+            height = (height + 1) & ~1;
+            width = (width + 1) & ~1;
+            picture->linesize[0] =
+            picture->linesize[1] = width;
+            size  = picture->linesize[0] * height;
+            picture->data[0] = ptr;
+            picture->data[1] = picture->data[0] + size;
+            return size + size / 2;
+        }
+
+        case AV_PIX_FMT_YUYV422:
+        case AV_PIX_FMT_UYVY422:
+            width = (width + 1) & ~1;
+            picture->linesize[0] = width * 2;
+            picture->data[0] = ptr;
+            return picture->linesize[0] * height;
+
+        case AV_PIX_FMT_BGR24:
+            picture->linesize[0] = (width * 3 + 3) & ~3;
+            picture->data[0] = ptr;
+            return picture->linesize[0] * height;
+
+        case AV_PIX_FMT_BGRA:
+            picture->linesize[0] = width * 4;
+            picture->data[0] = ptr;
+            return picture->linesize[0] * height;
+
+        case AV_PIX_FMT_P010LE:
+        {
+            int size;
+            height = (height + 1) & ~1;
+            width = (width + 1) & ~1;
+            picture->linesize[0] =
+            picture->linesize[1] = width * 2;
+            size  = picture->linesize[0] * height;
+            picture->data[0] = ptr;
+            picture->data[1] = picture->data[0] + size;
+            return size + size / 2;
+        }
+
+        case X264VFW_PIX_FMT_V210:
+            picture->linesize[0] = (width + 47) / 48 * 128;
+            picture->data[0] = ptr;
+            return picture->linesize[0] * height;
+
+        case X264VFW_PIX_FMT_Y410:
+            picture->linesize[0] = width * 4;
+            picture->data[0] = ptr;
+            return picture->linesize[0] * height;
+
+        case X264VFW_PIX_FMT_Y416:
+            picture->linesize[0] = width * 8;
+            picture->data[0] = ptr;
+            return picture->linesize[0] * height;
+
+        default:
+            return -1;
+    }
+}
+
+int x264vfw_picture_get_size(enum AVPixelFormat pix_fmt, int width, int height)
+{
+    AVPicture dummy_pict;
+    return x264vfw_picture_fill(&dummy_pict, NULL, pix_fmt, width, height);
+}
+
+static int x264vfw_picture_vflip(AVPicture *picture, enum AVPixelFormat pix_fmt, int width, int height)
+{
+    switch (pix_fmt)
+    {
+        // only RGB-formats can need vflip
+        case AV_PIX_FMT_BGR24:
+        case AV_PIX_FMT_BGRA:
+            picture->data[0] += picture->linesize[0] * (height - 1);
+            picture->linesize[0] = -picture->linesize[0];
+            break;
+
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+/* Move the plane pointers to the pixel (x, y), which must be on a chroma sample */
+static void x264vfw_picture_offset(uint8_t *data[4], const int linesize[4], enum AVPixelFormat pix_fmt, int x, int y)
+{
+    const AVPixFmtDescriptor *desc;
+    int plane, i;
+
+    if (X264VFW_PIX_FMT_IS_PACKED_HBD(pix_fmt))
+    {
+        /* V210 groups start every 6 pixels */
+        int step = pix_fmt == X264VFW_PIX_FMT_V210 ? 16 : pix_fmt == X264VFW_PIX_FMT_Y410 ? 4 : 8;
+        data[0] += (intptr_t)y * linesize[0] + (pix_fmt == X264VFW_PIX_FMT_V210 ? x / 6 : x) * step;
+        return;
+    }
+    desc = av_pix_fmt_desc_get(pix_fmt);
+    for (plane = 0; plane < 4; plane++)
+    {
+        if (!data[plane])
+            continue;
+        /* The first component stored in the plane gives its subsampling and pixel step */
+        for (i = 0; i < desc->nb_components; i++)
+            if (desc->comp[i].plane == plane)
+            {
+                int chroma = i == 1 || i == 2;
+                int cx = chroma ? x >> desc->log2_chroma_w : x;
+                int cy = chroma ? y >> desc->log2_chroma_h : y;
+                data[plane] += (intptr_t)cy * linesize[plane] + cx * desc->comp[i].step;
+                break;
+            }
+    }
+}
+
+/* Fill with a repeated pair of bytes (the first one is lo) */
+static void x264vfw_memset16(uint8_t *dst, uint16_t val, int count)
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        dst[2 * i]     = val & 0xff;
+        dst[2 * i + 1] = val >> 8;
+    }
+}
+
+/* Fill with a repeated group of pixels */
+static void x264vfw_memset_pattern(uint8_t *dst, const uint8_t *pattern, int pattern_size, int size)
+{
+    int i;
+    for (i = 0; i < size; i++)
+        dst[i] = pattern[i % pattern_size];
+}
+
+/* Black pixels of the packed high bit depth layouts (TV Scale), returns the size of the group */
+static int x264vfw_black_pattern(enum AVPixelFormat pix_fmt, uint8_t pattern[16])
+{
+    uint32_t words[4];
+    int i, count;
+
+    switch ((int)pix_fmt)
+    {
+        case X264VFW_PIX_FMT_V210:
+            words[0] = words[2] = 512 | 64 << 10 | 512 << 20;
+            words[1] = words[3] = 64 | 512 << 10 | 64 << 20;
+            count = 4;
+            break;
+
+        case X264VFW_PIX_FMT_Y410:
+            words[0] = 512 | 64 << 10 | 512 << 20 | 3u << 30;
+            count = 1;
+            break;
+
+        default:
+            /* Y416: U, Y, V and A */
+            words[0] = 0x8000 | 0x1000 << 16;
+            words[1] = 0x8000 | 0xffffu << 16;
+            count = 2;
+            break;
+    }
+    for (i = 0; i < 4 * count; i++)
+        pattern[i] = words[i / 4] >> (i % 4 * 8);
+    return 4 * count;
+}
+
+static void x264vfw_fill_black_frame(uint8_t *ptr, enum AVPixelFormat pix_fmt, int picture_size)
+{
+    if (X264VFW_PIX_FMT_IS_PACKED_HBD(pix_fmt))
+    {
+        uint8_t pattern[16];
+        x264vfw_memset_pattern(ptr, pattern, x264vfw_black_pattern(pix_fmt, pattern), picture_size);
+        return;
+    }
+
+    switch (pix_fmt)
+    {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_NV12:
+        {
+            int luma_size = picture_size * 2 / 3;
+            memset(ptr, 0x10, luma_size); /* TV Scale */
+            memset(ptr + luma_size, 0x80, picture_size - luma_size);
+            break;
+        }
+
+        case AV_PIX_FMT_YUV422P:
+        {
+            int luma_size = picture_size / 2;
+            memset(ptr, 0x10, luma_size); /* TV Scale */
+            memset(ptr + luma_size, 0x80, picture_size - luma_size);
+            break;
+        }
+
+        case AV_PIX_FMT_YUV444P:
+        {
+            int luma_size = picture_size / 3;
+            memset(ptr, 0x10, luma_size); /* TV Scale */
+            memset(ptr + luma_size, 0x80, picture_size - luma_size);
+            break;
+        }
+
+        case AV_PIX_FMT_P010LE:
+        {
+            int luma_size = picture_size * 2 / 3;
+            x264vfw_memset16(ptr, 64 << 6, luma_size / 2); /* TV Scale */
+            x264vfw_memset16(ptr + luma_size, 512 << 6, (picture_size - luma_size) / 2);
+            break;
+        }
+
+        case AV_PIX_FMT_YUYV422:
+            x264vfw_memset16(ptr, 0x8010, picture_size / 2); /* TV Scale */
+            break;
+
+        case AV_PIX_FMT_UYVY422:
+            x264vfw_memset16(ptr, 0x1080, picture_size / 2); /* TV Scale */
+            break;
+
+        default:
+            memset(ptr, 0x00, picture_size);
+            break;
+    }
+}
+
+/* Fill a part of the output picture with black, row by row */
+static void x264vfw_fill_black_rect(AVPicture *picture, enum AVPixelFormat pix_fmt, int width, int height)
+{
+    const AVPixFmtDescriptor *desc;
+    int chroma_w, chroma_h;
+    int y;
+
+    if (X264VFW_PIX_FMT_IS_PACKED_HBD(pix_fmt))
+    {
+        uint8_t pattern[16];
+        int pattern_size = x264vfw_black_pattern(pix_fmt, pattern);
+        /* Whole V210 groups, the rectangle starts on one */
+        int row_size = pix_fmt == X264VFW_PIX_FMT_V210 ? (width + 5) / 6 * 16 : width * pattern_size;
+        for (y = 0; y < height; y++)
+            x264vfw_memset_pattern(picture->data[0] + (intptr_t)y * picture->linesize[0], pattern, pattern_size, row_size);
+        return;
+    }
+
+    desc = av_pix_fmt_desc_get(pix_fmt);
+    chroma_w = width >> desc->log2_chroma_w;
+    chroma_h = height >> desc->log2_chroma_h;
+    switch (pix_fmt)
+    {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUV444P:
+        case AV_PIX_FMT_NV12:
+            for (y = 0; y < height; y++)
+                memset(picture->data[0] + (intptr_t)y * picture->linesize[0], 0x10, width); /* TV Scale */
+            /* NV12 has both chroma components in one plane */
+            if (pix_fmt == AV_PIX_FMT_NV12)
+                chroma_w *= 2;
+            for (y = 0; y < chroma_h; y++)
+            {
+                memset(picture->data[1] + (intptr_t)y * picture->linesize[1], 0x80, chroma_w);
+                if (picture->data[2])
+                    memset(picture->data[2] + (intptr_t)y * picture->linesize[2], 0x80, chroma_w);
+            }
+            break;
+
+        case AV_PIX_FMT_P010LE:
+            for (y = 0; y < height; y++)
+                x264vfw_memset16(picture->data[0] + (intptr_t)y * picture->linesize[0], 64 << 6, width); /* TV Scale */
+            for (y = 0; y < chroma_h; y++)
+                x264vfw_memset16(picture->data[1] + (intptr_t)y * picture->linesize[1], 512 << 6, chroma_w * 2);
+            break;
+
+        case AV_PIX_FMT_YUYV422:
+        case AV_PIX_FMT_UYVY422:
+            for (y = 0; y < height; y++)
+                x264vfw_memset16(picture->data[0] + (intptr_t)y * picture->linesize[0],
+                                 pix_fmt == AV_PIX_FMT_YUYV422 ? 0x8010 : 0x1080, width); /* TV Scale */
+            break;
+
+        default:
+            for (y = 0; y < height; y++)
+                memset(picture->data[0] + (intptr_t)y * picture->linesize[0], 0x00, width * desc->comp[0].step);
+            break;
+    }
+}
+
+/* Keyframe-only mode: show the last converted keyframe again instead of decoding */
+static int x264vfw_show_held_frame(CODEC *codec, uint8_t *output, int width, int height, const x264vfw_rect_t *dst, int hidden)
+{
+    int picture_size = x264vfw_picture_get_size(codec->decoder_pix_fmt, width, height);
+
+    codec->stats.frames_nonkey++;
+    /* Only whole pictures are kept, a part of the host's bitmap is left as it is */
+    if (hidden || dst->width != width || dst->height != height)
+        return 0;
+    if (picture_size < 0)
+    {
+        DPRINTF("x264vfw_picture_get_size failed\n");
+        X264VFW_EVENT_ERROR(codec);
+        return -1;
+    }
+    if (codec->decoder_held && codec->decoder_held_size == picture_size)
+        memcpy(output, codec->decoder_held, picture_size);
+    else
+    {
+        x264vfw_fill_black_frame(output, codec->decoder_pix_fmt, picture_size);
+        codec->stats.frames_black++;
+        X264VFW_EVENT(codec->events, X264VFW_EV_BLACK, X264VFW_EV_INSTANT, 0);
+    }
+    return 0;
+}
+
+/* Resilient mode: show the last good picture for one which is missing. It is copied back if it was kept,
+ * otherwise the host's buffer still has it. Black only before the first picture */
+static int x264vfw_conceal_frame(CODEC *codec, uint8_t *output, int width, int height, const x264vfw_rect_t *dst, int hidden)
+{
+    int picture_size = x264vfw_picture_get_size(codec->decoder_pix_fmt, width, height);
+
+    if (hidden)
+        return 0;
+    codec->stats.frames_concealed++;
+    if (dst->width != width || dst->height != height || picture_size < 0)
+        return 0;
+    if (codec->decoder_held && codec->decoder_held_size == picture_size)
+        memcpy(output, codec->decoder_held, picture_size);
+    else if (!codec->decoder_shown)
+    {
+        x264vfw_fill_black_frame(output, codec->decoder_pix_fmt, picture_size);
+        codec->stats.frames_black++;
+        X264VFW_EVENT(codec->events, X264VFW_EV_BLACK, X264VFW_EV_INSTANT, 0);
+    }
+    return 0;
+}
+
+static void x264vfw_cache_clear_pending(CODEC *codec)
+{
+    int i;
+    for (i = 0; i < codec->cache_pending_count; i++)
+        av_free(codec->cache_pending[i].data);
+    codec->cache_pending_count = 0;
+}
+
+/* The decoder was flushed: no picture is in it and the chain restarts at the next IRAP picture */
+static void x264vfw_cache_restart(CODEC *codec)
+{
+    x264vfw_cache_clear_pending(codec);
+    codec->cache_chain = 0;
+    codec->cache_cra_chain = 0;
+    codec->cache_inflight = 0;
+}
+
+/* Threads shared by all the decoders of the process */
+static int                  x264vfw_thread_budget;
+static int                  x264vfw_active_decoders;
+static x264vfw_threadpool_t *x264vfw_shared_threadpool; /* conversion workers */
+
+/* Start the shared workers ahead of the first stream, called at DRV_LOAD */
+void x264vfw_decoder_load(void)
+{
+    x264vfw_mutex_lock(&x264vfw_CS);
+    if (!x264vfw_thread_budget)
+    {
+        x264vfw_thread_budget = X264VFW_THREAD_BUDGET ? X264VFW_THREAD_BUDGET : x264vfw_cpu_num_processors();
+        x264vfw_thread_budget = X264VFW_MIN(X264VFW_MAX(x264vfw_thread_budget, 1), X264VFW_THREAD_MAX);
+        /* The calling thread converts one band itself */
+        if (x264vfw_thread_budget > 1)
+            x264vfw_threadpool_init(&x264vfw_shared_threadpool, x264vfw_thread_budget - 1);
+    }
+    x264vfw_mutex_unlock(&x264vfw_CS);
+}
+
+void x264vfw_decoder_unload(void)
+{
+    x264vfw_mutex_lock(&x264vfw_CS);
+    if (!x264vfw_active_decoders)
+    {
+        x264vfw_threadpool_delete(x264vfw_shared_threadpool);
+        x264vfw_shared_threadpool = NULL;
+        x264vfw_thread_budget = 0;
+    }
+    x264vfw_mutex_unlock(&x264vfw_CS);
+}
+
+/* Fair share of the budget for each decoder which is open */
+static int x264vfw_budget_share(void)
+{
+    int share;
+
+    x264vfw_mutex_lock(&x264vfw_CS);
+    share = X264VFW_MAX(x264vfw_thread_budget / X264VFW_MAX(x264vfw_active_decoders, 1), 1);
+    x264vfw_mutex_unlock(&x264vfw_CS);
+    return share;
+}
+
+static void x264vfw_budget_join(CODEC *codec)
+{
+    x264vfw_mutex_lock(&x264vfw_CS);
+    if (!codec->decoder_budget_joined)
+        x264vfw_active_decoders++;
+    codec->decoder_budget_joined = 1;
+    x264vfw_mutex_unlock(&x264vfw_CS);
+    /* A fixed thread count still counts as a decoder of the budget for the others */
+    if (codec->decoder_settings.threads)
+        codec->decoder_threads = codec->decoder_settings.threads;
+    else
+        codec->decoder_threads = x264vfw_budget_share();
+}
+
+static void x264vfw_budget_leave(CODEC *codec)
+{
+    x264vfw_mutex_lock(&x264vfw_CS);
+    if (codec->decoder_budget_joined)
+        x264vfw_active_decoders--;
+    codec->decoder_budget_joined = 0;
+    x264vfw_mutex_unlock(&x264vfw_CS);
+}
+
+/* Choose the decoder threads for the mode, must be called before avcodec_open2 */
+static void x264vfw_init_threading(CODEC *codec)
+{
+    AVCodecContext *ctx = codec->decoder_context;
+    int cpus = X264VFW_MIN(codec->decoder_threads, 16);
+
+    if (codec->decoder_mode == X264VFW_MODE_THROUGHPUT)
+    {
+        /* Frame threads, the output is delayed by thread_count - 1 frames */
+        ctx->thread_type = FF_THREAD_FRAME;
+        ctx->thread_count = cpus;
+        return;
+    }
+
+    /* Slice threads never delay the output. libavcodec uses them for the WPP rows only,
+       tiles and multiple slices are decoded serially so don't spawn threads which would sit idle */
+    ctx->thread_type = FF_THREAD_SLICE;
+    if (codec->decoder_pps_valid && !codec->decoder_pps.entropy_coding_sync_enabled)
+        ctx->thread_count = 1;
+    else
+        ctx->thread_count = cpus;
+}
+
+int x264vfw_decoder_get_expected_delay(CODEC *codec)
+{
+    int delay = 0;
+
+    if (!codec->decoder_context)
+        return 0;
+
+    if (codec->decoder_sps_valid)
+        delay += codec->decoder_sps.max_num_reorder_pics;
+    if (codec->decoder_context->active_thread_type & FF_THREAD_FRAME)
+        delay += codec->decoder_context->thread_count - 1;
+    return delay;
+}
+
+/* Frames the decoder may hold at once: the DPB, one per frame thread and the one being converted */
+static int x264vfw_framepool_frames(CODEC *codec)
+{
+    AVCodecContext *ctx = codec->decoder_context;
+    int frames = codec->decoder_sps_valid ? codec->decoder_sps.max_dec_pic_buffering : 16;
+
+    if (ctx->thread_type & FF_THREAD_FRAME)
+        frames += ctx->thread_count;
+    return frames + 2;
+}
+
+int x264vfw_decoder_open(CODEC *codec, int width, int height, uint32_t fourcc,
+                         const uint8_t *extradata, int extradata_size, int csp)
+{
+    int i_csp = csp;
+
+    codec->decoder_vflip = (i_csp & X264VFW_CSP_VFLIP) != 0;
+    i_csp &= X264VFW_CSP_MASK;
+    codec->decoder_pix_fmt = x264vfw_csp_to_pix_fmt(i_csp);
+    codec->decoder_width = width;
+    codec->decoder_height = height;
+    codec->decoder_swap_UV = i_csp == X264VFW_CSP_YV12 || i_csp == X264VFW_CSP_YV16 || i_csp == X264VFW_CSP_YV24;
+    x264vfw_csp_init(x264vfw_cpu_detect(), &codec->csp);
+    codec->decoder_settings = codec->settings;
+
+    /* Normally done at DRV_LOAD already. The threads have to be known before avcodec_open2,
+       so each failure below leaves the budget again */
+    x264vfw_decoder_load();
+    x264vfw_budget_join(codec);
+
+    codec->convert_threads = codec->decoder_settings.convert_threads ? codec->decoder_settings.convert_threads
+                                                                      : codec->decoder_threads;
+    codec->convert_threads = X264VFW_MIN(X264VFW_MAX(codec->convert_threads, 1), X264VFW_THREAD_MAX);
+    codec->threadpool = x264vfw_shared_threadpool;
+
+    codec->decoder = avcodec_find_decoder(AV_CODEC_ID_HEVC);
+    if (!codec->decoder)
+    {
+        DPRINTF("avcodec_find_decoder failed\n");
+        x264vfw_budget_leave(codec);
+        return X264VFW_DECODER_ERROR;
+    }
+
+    codec->decoder_context = avcodec_alloc_context3(codec->decoder);
+    if (!codec->decoder_context)
+    {
+        DPRINTF("avcodec_alloc_context failed\n");
+        x264vfw_budget_leave(codec);
+        return X264VFW_DECODER_ERROR;
+    }
+
+    codec->decoder_frame = av_frame_alloc();
+    if (!codec->decoder_frame)
+    {
+        DPRINTF("av_frame_alloc failed\n");
+        av_freep(&codec->decoder_context);
+        x264vfw_budget_leave(codec);
+        return X264VFW_DECODER_ERROR;
+    }
+
+    /* Nothing of the previous stream, an in-band SPS is looked for again */
+    codec->decoder_sps_valid = 0;
+    codec->decoder_pps_valid = 0;
+    codec->decoder_nal_length_size = -1; //detected on the first packet if there is no extradata
+    codec->decoder_context->coded_width  = width;
+    codec->decoder_context->coded_height = height;
+    codec->decoder_context->codec_tag = fourcc;
+
+    if (extradata && extradata_size > 4)
+    {
+        const uint8_t *buf = extradata;
+        uint32_t buf_size = extradata_size;
+        int annexb_size = -1;
+        /* Check supported formats of extradata */
+        if (x264vfw_hevc_is_hvcc(buf, buf_size))
+        {
+            /* Give the parameter sets to the decoder as Annex B, the packets are rewritten to match */
+            codec->decoder_nal_length_size = x264vfw_hevc_hvcc_nal_length_size(buf);
+            if (codec->decoder_nal_length_size < 0)
+            {
+                DPRINTF("invalid hvcC NAL unit length size\n");
+                av_freep(&codec->decoder_context);
+                av_frame_free(&codec->decoder_frame);
+                x264vfw_budget_leave(codec);
+                return X264VFW_DECODER_BADFORMAT;
+            }
+            annexb_size = x264vfw_hevc_hvcc_to_annexb(NULL, buf, buf_size);
+            if (annexb_size >= 0 && (codec->decoder_extradata = av_malloc(annexb_size + FF_INPUT_BUFFER_PADDING_SIZE)))
+                x264vfw_hevc_hvcc_to_annexb(codec->decoder_extradata, buf, buf_size);
+        }
+        else if (buf[0] == 0x00 && buf[1] == 0x00 && (buf[2] == 0x01 || (buf[2] == 0x00 && buf[3] == 0x01)))
+        {
+            codec->decoder_nal_length_size = 0;
+            annexb_size = buf_size;
+            if ((codec->decoder_extradata = av_malloc(annexb_size + FF_INPUT_BUFFER_PADDING_SIZE)))
+                memcpy(codec->decoder_extradata, buf, buf_size);
+        }
+        if (codec->decoder_extradata)
+        {
+            memset(codec->decoder_extradata + annexb_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+            codec->decoder_context->extradata = codec->decoder_extradata;
+            codec->decoder_context->extradata_size = annexb_size;
+        }
+        if (x264vfw_hevc_parse_extradata(&codec->decoder_sps, buf, buf_size) == 0)
+            codec->decoder_sps_valid = 1;
+        if (x264vfw_hevc_parse_extradata_pps(&codec->decoder_pps, buf, buf_size) == 0)
+            codec->decoder_pps_valid = 1;
+    }
+
+    codec->decoder_mode = codec->decoder_settings.mode;
+    x264vfw_init_threading(codec);
+
+    /* Errors in the NAL units fail the packet instead of giving a picture with parts missing */
+    if (codec->decoder_settings.resilient)
+        codec->decoder_context->err_recognition |= AV_EF_EXPLODE;
+
+    if (codec->decoder_settings.frame_pool && x264vfw_framepool_init(&codec->framepool, x264vfw_framepool_frames(codec)) == 0)
+        x264vfw_framepool_attach(codec->framepool, codec->decoder_context);
+
+    if (avcodec_open2(codec->decoder_context, codec->decoder, NULL) < 0)
+    {
+        DPRINTF("avcodec_open failed\n");
+        av_freep(&codec->decoder_context);
+        av_frame_free(&codec->decoder_frame);
+        av_freep(&codec->decoder_extradata);
+        x264vfw_budget_leave(codec);
+        return X264VFW_DECODER_ERROR;
+    }
+
+    av_init_packet(&codec->decoder_pkt);
+    codec->decoder_pkt.data = NULL;
+    codec->decoder_pkt.size = 0;
+
+    if (codec->decoder_settings.cache_size)
+        x264vfw_cache_init(&codec->cache, (uint64_t)codec->decoder_settings.cache_size << 20);
+    x264vfw_cache_restart(codec);
+
+    codec->decoder_frames_in = 0;
+    codec->decoder_delay = -1;
+    codec->decoder_draining = 0;
+    /* A live stream may be joined anywhere, start at its first IRAP picture */
+    codec->decoder_resync = codec->decoder_settings.resilient != X264VFW_RESILIENT_OFF;
+    codec->decoder_shown = 0;
+    codec->stats.decoder_opens++;
+
+    return 0;
+}
+
+/* Other than keyframe_only, which doesn't need the decoder to be opened again */
+static int x264vfw_settings_changed(CODEC *codec)
+{
+    x264vfw_settings_t settings = codec->settings;
+
+    settings.keyframe_only = codec->decoder_settings.keyframe_only;
+    return memcmp(&settings, &codec->decoder_settings, sizeof(x264vfw_settings_t)) != 0;
+}
+
+/* Hosts begin again on every seek, with an unchanged format only the decoder state has to go */
+int x264vfw_decoder_restart(CODEC *codec)
+{
+    if (!codec->decoder_context)
+        return -1;
+    /* Decoders were opened or closed since, take the new share of the thread budget */
+    if (!codec->decoder_settings.threads && codec->decoder_threads != x264vfw_budget_share())
+        return -1;
+    if (x264vfw_settings_changed(codec))
+        return -1;
+
+    avcodec_flush_buffers(codec->decoder_context);
+    /* The cached pictures stay valid */
+    x264vfw_cache_restart(codec);
+    av_freep(&codec->decoder_held);
+    codec->decoder_held_size = 0;
+    codec->decoder_frames_in = 0;
+    codec->decoder_draining = 0;
+    codec->decoder_resync = codec->decoder_settings.resilient != X264VFW_RESILIENT_OFF;
+    codec->decoder_shown = 0;
+    codec->stats.decoder_restarts++;
+    return 0;
+}
+
+/* handle the deprecated jpeg pixel formats */
+static int handle_jpeg(int pix_fmt, int *fullrange)
+{
+    switch (pix_fmt)
+    {
+        case AV_PIX_FMT_YUVJ420P: *fullrange = 1; return AV_PIX_FMT_YUV420P;
+        case AV_PIX_FMT_YUVJ422P: *fullrange = 1; return AV_PIX_FMT_YUV422P;
+        case AV_PIX_FMT_YUVJ444P: *fullrange = 1; return AV_PIX_FMT_YUV444P;
+        default:                                  return pix_fmt;
+    }
+}
+
+static const int *x264vfw_get_coefficients(int colorspace)
+{
+    switch (colorspace)
+    {
+        case AVCOL_SPC_BT709:
+            return sws_getCoefficients(SWS_CS_ITU709);
+        case AVCOL_SPC_FCC:
+            return sws_getCoefficients(SWS_CS_FCC);
+        case AVCOL_SPC_BT470BG:
+            return sws_getCoefficients(SWS_CS_ITU601);
+        case AVCOL_SPC_SMPTE170M:
+            return sws_getCoefficients(SWS_CS_SMPTE170M);
+        case AVCOL_SPC_SMPTE240M:
+            return sws_getCoefficients(SWS_CS_SMPTE240M);
+        default:
+            return sws_getCoefficients(SWS_CS_DEFAULT);
+    }
+}
+
+static struct SwsContext *x264vfw_init_sws_context(CODEC *codec, int src_width, int src_height, int dst_width, int dst_height)
+{
+    struct SwsContext *sws = sws_alloc_context();
+    if (!sws)
+        return NULL;
+
+    int flags;
+
+    switch (codec->decoder_settings.quality)
+    {
+        case X264VFW_QUALITY_FAST:
+            flags = SWS_FAST_BILINEAR;
+            break;
+
+        case X264VFW_QUALITY_NORMAL:
+            flags = SWS_BILINEAR | SWS_ACCURATE_RND;
+            break;
+
+        default:
+            flags = SWS_BICUBIC |
+                    SWS_FULL_CHR_H_INP | SWS_ACCURATE_RND;
+            break;
+    }
+
+    /* The frame, the stream may have changed since the decoder was opened */
+    AVFrame *frame = codec->decoder_frame;
+    int src_range = frame->color_range == AVCOL_RANGE_JPEG;
+    int src_pix_fmt = handle_jpeg(frame->format, &src_range);
+
+    int dst_range = src_range; //maintain source range
+    int dst_pix_fmt = handle_jpeg(codec->decoder_pix_fmt, &dst_range);
+
+    av_opt_set_int(sws, "sws_flags",  flags,       0);
+
+    av_opt_set_int(sws, "srcw",       src_width,   0);
+    av_opt_set_int(sws, "srch",       src_height,  0);
+    av_opt_set_int(sws, "src_format", src_pix_fmt, 0);
+    av_opt_set_int(sws, "src_range",  src_range,   0);
+
+    av_opt_set_int(sws, "dstw",       dst_width,   0);
+    av_opt_set_int(sws, "dsth",       dst_height,  0);
+    av_opt_set_int(sws, "dst_format", dst_pix_fmt, 0);
+    av_opt_set_int(sws, "dst_range",  dst_range,   0);
+
+    /* SWS_FULL_CHR_H_INT is correctly supported only for RGB formats */
+    if (dst_pix_fmt == AV_PIX_FMT_BGR24 || dst_pix_fmt == AV_PIX_FMT_BGRA)
+        flags |= SWS_FULL_CHR_H_INT;
+
+    const int *coefficients = x264vfw_get_coefficients(frame->colorspace);
+    sws_setColorspaceDetails(sws,
+                             coefficients, src_range,
+                             coefficients, dst_range,
+                             0, 1<<16, 1<<16);
+
+    if (sws_init_context(sws, NULL, NULL) < 0)
+    {
+        sws_freeContext(sws);
+        return NULL;
+    }
+    return sws;
+}
+
+enum
+{
+    X264VFW_CONVERT_SWS,
+    X264VFW_CONVERT_COPY,
+    X264VFW_CONVERT_RGB,
+    X264VFW_CONVERT_PACK,
+    X264VFW_CONVERT_DITHER,
+    X264VFW_CONVERT_TONEMAP
+};
+
+/* One colorspace conversion, split into horizontal bands */
+typedef struct
+{
+    CODEC     *codec;
+    AVPicture *picture;     /* points to the destination rectangle */
+    uint8_t   *src[4];      /* decoded frame moved to the source rectangle */
+    int       *src_linesize;
+    int       src_width;
+    int       src_height;
+    int       method;
+    int       width;
+    int       height;
+    int       bands;
+    int       chroma_shift_w;
+    int       chroma_shift_h;
+    int       depth;        /* bits per sample of the decoded frame */
+    int       pack_csp;     /* X264VFW_CSP_* written by x264vfw_yuv2hbd */
+    x264vfw_yuv2rgb_coeffs_t coeffs;
+} x264vfw_convert_t;
+
+/* Build the tone mapping tables if the stream has an HDR transfer and it is on. Returns 1 if the frame is tone mapped */
+static int x264vfw_tonemap_select(CODEC *codec, int depth, int full_range)
+{
+    AVFrame *frame = codec->decoder_frame;
+    int transfer;
+
+    if (!codec->decoder_settings.tonemap || depth <= 8)
+        return 0;
+    if (frame->color_trc == AVCOL_TRC_SMPTE2084)
+        transfer = X264VFW_TONEMAP_PQ;
+    else if (frame->color_trc == AVCOL_TRC_ARIB_STD_B67)
+        transfer = X264VFW_TONEMAP_HLG;
+    else
+        return 0;
+
+    if (!codec->tonemap)
+    {
+        if (!(codec->tonemap = av_mallocz(sizeof(x264vfw_tonemap_t))))
+        {
+            DPRINTF("can't allocate the tone mapping tables\n");
+            return 0;
+        }
+    }
+    /* HDR10 and HLG have the BT.2020 matrix whatever colorspace says, unspecified primaries are taken as BT.2020 */
+    x264vfw_tonemap_init(codec->tonemap, transfer,
+                         frame->color_primaries == AVCOL_PRI_BT2020 || frame->color_primaries == AVCOL_PRI_UNSPECIFIED,
+                         depth, full_range, codec->decoder_settings.tonemap_peak);
+    return 1;
+}
+
+/* Choose how to convert the decoded frame:
+ * - copy the planes as is when the output has the same layout
+ * - dither more than 8 bits down to the 8-bit planar layouts of the same subsampling (1:1 only)
+ * - tone map PQ/HLG to SDR BGRA/BGR24 in the same pass as the YUV -> RGB (1:1, more than 8 bits only)
+ * - convert planar 4:2:0/4:2:2 YUV to BGRA/BGR24 without swscale (1:1 of even size, 8-bit only): the vertical
+ *   chroma filter and the arithmetic of swscale at the quality in use, so the output is the same as its own
+ * - shift and pack the samples for the high bit depth layouts (1:1 only)
+ * - swscale for everything else */
+static void x264vfw_convert_select(x264vfw_convert_t *cv)
+{
+    CODEC *codec = cv->codec;
+    AVFrame *frame = codec->decoder_frame;
+    int src_range = frame->color_range == AVCOL_RANGE_JPEG;
+    int src_pix_fmt = handle_jpeg(frame->format, &src_range);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(src_pix_fmt);
+
+    cv->method = X264VFW_CONVERT_SWS;
+    if (cv->src_width != cv->width || cv->src_height != cv->height)
+        return;
+
+    /* Planar 4:2:0, 4:2:2 or 4:4:4 YUV of up to 16 bits in the byte order of the CPU */
+    if (!desc || desc->nb_components < 3 || desc->comp[1].plane != 1 || desc->comp[2].plane != 2 ||
+        (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_BE)) || desc->comp[0].depth > 16 ||
+        desc->log2_chroma_w > 1 || desc->log2_chroma_h > desc->log2_chroma_w)
+        return;
+    cv->chroma_shift_w = desc->log2_chroma_w;
+    cv->chroma_shift_h = desc->log2_chroma_h;
+    cv->depth = desc->comp[0].depth;
+
+    switch ((int)codec->decoder_pix_fmt)
+    {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUV444P:
+        case AV_PIX_FMT_NV12:
+        {
+            const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get(codec->decoder_pix_fmt);
+            if (dst_desc->log2_chroma_w != cv->chroma_shift_w || dst_desc->log2_chroma_h != cv->chroma_shift_h)
+                break;
+            cv->method = cv->depth > 8 ? X264VFW_CONVERT_DITHER : X264VFW_CONVERT_COPY;
+            break;
+        }
+
+        case AV_PIX_FMT_BGR24:
+        case AV_PIX_FMT_BGRA:
+            if (x264vfw_tonemap_select(codec, cv->depth, src_range))
+            {
+                cv->method = X264VFW_CONVERT_TONEMAP;
+                break;
+            }
+            /* swscale halves the chroma of 4:4:4 for packed RGB and scales it by other than 2 for odd sizes */
+            if (cv->depth != 8 || !cv->chroma_shift_w || (cv->width & 1) || (cv->height & cv->chroma_shift_h))
+                break;
+            /* Same matrix and range selection as x264vfw_init_sws_context */
+            x264vfw_yuv2rgb_init(&cv->coeffs, x264vfw_get_coefficients(frame->colorspace), src_range,
+                                 codec->decoder_settings.quality, cv->chroma_shift_h);
+            cv->method = X264VFW_CONVERT_RGB;
+            break;
+
+        case AV_PIX_FMT_P010LE:
+            if (cv->depth > 8 && cv->chroma_shift_w && cv->chroma_shift_h)
+            {
+                cv->pack_csp = X264VFW_CSP_P010;
+                cv->method = X264VFW_CONVERT_PACK;
+            }
+            break;
+
+        case X264VFW_PIX_FMT_V210:
+            cv->pack_csp = X264VFW_CSP_V210;
+            cv->method = X264VFW_CONVERT_PACK;
+            break;
+
+        case X264VFW_PIX_FMT_Y410:
+            cv->pack_csp = X264VFW_CSP_Y410;
+            cv->method = X264VFW_CONVERT_PACK;
+            break;
+
+        case X264VFW_PIX_FMT_Y416:
+            cv->pack_csp = X264VFW_CSP_Y416;
+            cv->method = X264VFW_CONVERT_PACK;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* First row of the band, kept even so 4:2:0 chroma rows are never split */
+static int x264vfw_band_start(x264vfw_convert_t *cv, int band)
+{
+    if (band >= cv->bands)
+        return cv->height;
+    return (int)((int64_t)cv->height * band / cv->bands) & ~1;
+}
+
+static void x264vfw_copy_band(x264vfw_convert_t *cv, int y_start, int y_end)
+{
+    AVPicture *picture = cv->picture;
+    uint8_t **src = cv->src;
+    int *src_linesize = cv->src_linesize;
+    int chroma_w = (cv->width + (1 << cv->chroma_shift_w) - 1) >> cv->chroma_shift_w;
+    int chroma_start = y_start >> cv->chroma_shift_h;
+    int chroma_end = (y_end + (1 << cv->chroma_shift_h) - 1) >> cv->chroma_shift_h;
+    int i;
+
+    x264vfw_plane_copy(picture->data[0] + (intptr_t)y_start * picture->linesize[0], picture->linesize[0],
+                       src[0] + (intptr_t)y_start * src_linesize[0], src_linesize[0],
+                       cv->width, y_end - y_start);
+    if (cv->codec->decoder_pix_fmt == AV_PIX_FMT_NV12)
+    {
+        x264vfw_plane_copy_interleave(picture->data[1] + (intptr_t)chroma_start * picture->linesize[1], picture->linesize[1],
+                                      src[1] + (intptr_t)chroma_start * src_linesize[1], src_linesize[1],
+                                      src[2] + (intptr_t)chroma_start * src_linesize[2], src_linesize[2],
+                                      chroma_w, chroma_end - chroma_start);
+        return;
+    }
+    for (i = 1; i < 3; i++)
+        x264vfw_plane_copy(picture->data[i] + (intptr_t)chroma_start * picture->linesize[i], picture->linesize[i],
+                           src[i] + (intptr_t)chroma_start * src_linesize[i], src_linesize[i],
+                           chroma_w, chroma_end - chroma_start);
+}
+
+/* swscale converts the whole picture in one piece: a context per band would filter the chroma as if the
+ * picture ended at the band edges */
+static void x264vfw_sws_convert(x264vfw_convert_t *cv)
+{
+    sws_scale(cv->codec->sws, (const uint8_t * const *)cv->src, cv->src_linesize, 0, cv->src_height,
+              cv->picture->data, cv->picture->linesize);
+}
+
+static void x264vfw_convert_band(void *arg, int band)
+{
+    x264vfw_convert_t *cv = arg;
+    int y_start = x264vfw_band_start(cv, band);
+    int y_end = x264vfw_band_start(cv, band + 1);
+
+    X264VFW_EVENT(cv->codec->events, X264VFW_EV_BAND, X264VFW_EV_BEGIN, band);
+    switch (cv->method)
+    {
+        case X264VFW_CONVERT_COPY:
+            x264vfw_copy_band(cv, y_start, y_end);
+            break;
+
+        case X264VFW_CONVERT_RGB:
+            x264vfw_yuv2rgb(&cv->codec->csp, &cv->coeffs, cv->codec->decoder_pix_fmt == AV_PIX_FMT_BGR24,
+                            cv->picture->data[0], cv->picture->linesize[0],
+                            cv->src, cv->src_linesize,
+                            cv->chroma_shift_h, cv->width, cv->height, y_start, y_end);
+            break;
+
+        case X264VFW_CONVERT_TONEMAP:
+            x264vfw_yuv2rgb_tonemap(&cv->codec->csp, cv->codec->tonemap, cv->codec->decoder_pix_fmt == AV_PIX_FMT_BGR24,
+                                    cv->picture->data[0], cv->picture->linesize[0],
+                                    cv->src, cv->src_linesize,
+                                    cv->chroma_shift_w, cv->chroma_shift_h, cv->width, y_start, y_end);
+            break;
+
+        case X264VFW_CONVERT_DITHER:
+            x264vfw_yuv_dither(&cv->codec->csp, cv->picture->data, cv->picture->linesize,
+                               cv->src, cv->src_linesize, cv->depth, cv->codec->decoder_pix_fmt == AV_PIX_FMT_NV12,
+                               cv->chroma_shift_w, cv->chroma_shift_h, cv->width, y_start, y_end);
+            break;
+
+        case X264VFW_CONVERT_PACK:
+            x264vfw_yuv2hbd(&cv->codec->csp, cv->pack_csp, cv->picture->data, cv->picture->linesize,
+                            cv->src, cv->src_linesize, cv->depth,
+                            cv->chroma_shift_w, cv->chroma_shift_h, cv->width, y_start, y_end);
+            break;
+
+        default:
+            x264vfw_sws_convert(cv);
+            break;
+    }
+    X264VFW_EVENT(cv->codec->events, X264VFW_EV_BAND, X264VFW_EV_END, band);
+}
+
+static void x264vfw_free_sws(CODEC *codec)
+{
+    sws_freeContext(codec->sws);
+    codec->sws = NULL;
+}
+
+static int x264vfw_init_sws(CODEC *codec, x264vfw_convert_t *cv)
+{
+    AVFrame *frame = codec->decoder_frame;
+    x264vfw_sws_key_t key;
+
+    key.src_width = cv->src_width;
+    key.src_height = cv->src_height;
+    key.src_format = frame->format;
+    key.src_range = frame->color_range;
+    key.src_colorspace = frame->colorspace;
+    key.width = cv->width;
+    key.height = cv->height;
+    if (codec->sws && !memcmp(&key, &codec->sws_key, sizeof(key)))
+        return 0;
+
+    if (codec->sws && (key.src_width != codec->sws_key.src_width || key.src_height != codec->sws_key.src_height ||
+                       key.src_format != codec->sws_key.src_format))
+        DPRINTF("the stream changed from %dx%d %s to %dx%d %s\n",
+                codec->sws_key.src_width, codec->sws_key.src_height, av_get_pix_fmt_name(codec->sws_key.src_format),
+                key.src_width, key.src_height, av_get_pix_fmt_name(key.src_format));
+    x264vfw_free_sws(codec);
+    /* Scaling is folded into the conversion */
+    codec->sws = x264vfw_init_sws_context(codec, cv->src_width, cv->src_height, cv->width, cv->height);
+    if (!codec->sws)
+        return -1;
+    codec->sws_key = key;
+    codec->stats.sws_rebuilds++;
+    return 0;
+}
+
+/* Fill the output picture for the (width x height) bitmap and move it to the destination rectangle */
+static int x264vfw_output_picture(CODEC *codec, AVPicture *picture, uint8_t *output, int width, int height, const x264vfw_rect_t *dst)
+{
+    if (x264vfw_picture_fill(picture, output, codec->decoder_pix_fmt, width, height) < 0)
+    {
+        DPRINTF("x264vfw_picture_fill failed\n");
+        X264VFW_EVENT_ERROR(codec);
+        return -1;
+    }
+    if (codec->decoder_swap_UV)
+    {
+        uint8_t *temp_data;
+        int     temp_linesize;
+
+        temp_data = picture->data[1];
+        temp_linesize = picture->linesize[1];
+        picture->data[1] = picture->data[2];
+        picture->linesize[1] = picture->linesize[2];
+        picture->data[2] = temp_data;
+        picture->linesize[2] = temp_linesize;
+    }
+    if (codec->decoder_vflip)
+        if (x264vfw_picture_vflip(picture, codec->decoder_pix_fmt, width, height) < 0)
+        {
+            DPRINTF("x264vfw_picture_vflip failed\n");
+            X264VFW_EVENT_ERROR(codec);
+            return -1;
+        }
+    /* Rows are counted from the top of the image, also for bottom-up bitmaps */
+    x264vfw_picture_offset(picture->data, picture->linesize, codec->decoder_pix_fmt, dst->x, dst->y);
+    return 0;
+}
+
+/* Put the source rectangle of the decoded picture into the destination one in a single pass */
+static int x264vfw_convert_picture(CODEC *codec, AVPicture *picture, const x264vfw_rect_t *src, const x264vfw_rect_t *dst)
+{
+    AVFrame *frame = codec->decoder_frame;
+    x264vfw_convert_t cv;
+    x264vfw_rect_t rect;
+    int x, y, i;
+
+    /* Another size than the stream was opened with (a switch of adaptive renditions, another conformance
+     * window): the rectangle is mapped onto the frame and the result scaled into the destination */
+    if (codec->decoder_width > 0 && codec->decoder_height > 0 &&
+        (frame->width != codec->decoder_width || frame->height != codec->decoder_height))
+    {
+        rect.x = (int)((int64_t)src->x * frame->width / codec->decoder_width) & ~1;
+        rect.y = (int)((int64_t)src->y * frame->height / codec->decoder_height) & ~1;
+        rect.width = X264VFW_MAX((int)((int64_t)src->width * frame->width / codec->decoder_width), 1);
+        rect.height = X264VFW_MAX((int)((int64_t)src->height * frame->height / codec->decoder_height), 1);
+        src = &rect;
+    }
+
+    cv.codec = codec;
+    cv.picture = picture;
+    for (i = 0; i < 4; i++)
+        cv.src[i] = frame->data[i];
+    cv.src_linesize = frame->linesize;
+    /* Crop by pointer arithmetic. The frame may be smaller than the stream header says (x264vfw_get_ex_rects
+     * checks against the header) and the mapping rounds: the rectangle is clamped to the frame, the corner
+     * stays on a chroma sample */
+    x = X264VFW_MIN(src->x, (frame->width - 1) & ~1);
+    y = X264VFW_MIN(src->y, (frame->height - 1) & ~1);
+    cv.src_width = X264VFW_MIN(src->width, frame->width - x);
+    cv.src_height = X264VFW_MIN(src->height, frame->height - y);
+    x264vfw_picture_offset(cv.src, cv.src_linesize, frame->format, x, y);
+    cv.width = dst->width;
+    cv.height = dst->height;
+    x264vfw_convert_select(&cv);
+
+    /* Bands need at least X264VFW_CONVERT_BAND_HEIGHT rows, swscale runs in one piece */
+    cv.bands = X264VFW_MAX(X264VFW_MIN(codec->convert_threads, cv.height / X264VFW_CONVERT_BAND_HEIGHT), 1);
+    if (cv.method == X264VFW_CONVERT_SWS && X264VFW_PIX_FMT_IS_PACKED_HBD(codec->decoder_pix_fmt))
+    {
+        /* Nothing but x264vfw_yuv2hbd writes them, see x264vfw_get_ex_rects */
+        DPRINTF("can't convert %s to the output format\n", av_get_pix_fmt_name(frame->format));
+        X264VFW_EVENT_ERROR(codec);
+        return -1;
+    }
+    if (cv.method == X264VFW_CONVERT_SWS)
+    {
+        cv.bands = 1;
+        if (x264vfw_init_sws(codec, &cv) < 0)
+        {
+            DPRINTF("x264vfw_init_sws_context failed\n");
+            X264VFW_EVENT_ERROR(codec);
+            return -1;
+        }
+    }
+
+    x264vfw_threadpool_run(codec->threadpool, x264vfw_convert_band, &cv, cv.bands);
+    return 0;
+}
+
+/* Check that the buffer holds size prefixed NAL units which must be converted to Annex B */
+static int x264vfw_is_size_prefixed(const uint8_t *buf, uint32_t buf_size)
+{
+    uint32_t nal_size;
+
+    if (buf_size < 4)
+        return 0;
+    nal_size = endian_fix32(*(uint32_t *)buf);
+    /* Check startcode */
+    if (nal_size == 0x00000001)
+        return 0;
+    while ((uint64_t)buf_size >= (uint64_t)nal_size + 8)
+    {
+        buf += nal_size + 4;
+        buf_size -= nal_size + 4;
+        nal_size = endian_fix32(*(uint32_t *)buf);
+    }
+    return (uint64_t)buf_size == (uint64_t)nal_size + 4;
+}
+
+/* Copy size prefixed NAL units replacing the sizes with startcodes. Returns the size of the result
+ * which is at most size / length_size * 4 + 4 */
+static uint32_t x264vfw_copy_annexb(uint8_t *dst, const uint8_t *src, uint32_t size, int length_size)
+{
+    uint8_t *p = dst;
+
+    while (size >= (uint32_t)length_size)
+    {
+        uint32_t nal_size = 0;
+        int i;
+        for (i = 0; i < length_size; i++)
+            nal_size = (nal_size << 8) | *src++;
+        size -= length_size;
+        if (nal_size > size)
+        {
+            DPRINTF("truncated NAL unit\n");
+            break;
+        }
+        p[0] = 0x00;
+        p[1] = 0x00;
+        p[2] = 0x00;
+        p[3] = 0x01;
+        memcpy(p + 4, src, nal_size);
+        p += nal_size + 4;
+        src += nal_size;
+        size -= nal_size;
+    }
+    return p - dst;
+}
+
+/* Start of a stage which is timed and traced, see x264vfw_stage_end */
+static inline int64_t x264vfw_stage_begin(CODEC *codec, int type)
+{
+    X264VFW_EVENT(codec->events, type, X264VFW_EV_BEGIN, 0);
+    return x264vfw_mdate();
+}
+
+static inline void x264vfw_stage_end(CODEC *codec, int type, x264vfw_stage_stats_t *stage, int64_t start)
+{
+    x264vfw_stats_add_time(stage, x264vfw_mdate() - start);
+    X264VFW_EVENT(codec->events, type, X264VFW_EV_END, 0);
+}
+
+/* Point decoder_pkt to the input, copying it into a pooled padded buffer only if needed. The bitstream
+ * readers read up to FF_INPUT_BUFFER_PADDING_SIZE bytes past the end, which must be zeroed: only the
+ * buffers of the driver (padded) have them, the ones of the host are always copied */
+static int x264vfw_prepare_packet(CODEC *codec, uint8_t *input, uint32_t size, int padded)
+{
+    AVPacket *pkt = &codec->decoder_pkt;
+    uint32_t alloc_size = size;
+
+    codec->stats.bytes_in += size;
+
+    /* Frame threads would copy a plain packet anyway, a refcounted one is only referenced */
+    if (padded && !codec->decoder_nal_length_size && !(codec->decoder_context->active_thread_type & FF_THREAD_FRAME))
+    {
+        pkt->buf = NULL;
+        pkt->data = input;
+        pkt->size = size;
+        return 0;
+    }
+
+    /* Check overflow */
+    if (size > INT_MAX / 4 - FF_INPUT_BUFFER_PADDING_SIZE - 0xffff)
+    {
+        DPRINTF("buffer overflow check failed\n");
+        X264VFW_EVENT_ERROR(codec);
+        return -1;
+    }
+    if (codec->decoder_nal_length_size)
+        alloc_size = size / codec->decoder_nal_length_size * 4 + 4;
+    if (codec->decoder_pkt_pool_size < alloc_size + FF_INPUT_BUFFER_PADDING_SIZE)
+    {
+        /* Grow in 64 KB steps. Buffers still referenced by the decoder are freed when it releases them */
+        uint32_t pool_size = (alloc_size + FF_INPUT_BUFFER_PADDING_SIZE + 0xffff) & ~0xffff;
+        av_buffer_pool_uninit(&codec->decoder_pkt_pool);
+        codec->decoder_pkt_pool_size = 0;
+        codec->decoder_pkt_pool = av_buffer_pool_init(pool_size, NULL);
+        if (!codec->decoder_pkt_pool)
+        {
+            DPRINTF("av_buffer_pool_init failed\n");
+            X264VFW_EVENT_ERROR(codec);
+            return -1;
+        }
+        codec->decoder_pkt_pool_size = pool_size;
+    }
+    pkt->buf = av_buffer_pool_get(codec->decoder_pkt_pool);
+    if (!pkt->buf)
+    {
+        DPRINTF("av_buffer_pool_get failed\n");
+        X264VFW_EVENT_ERROR(codec);
+        return -1;
+    }
+    pkt->data = pkt->buf->data;
+    if (codec->decoder_nal_length_size)
+    {
+        X264VFW_EVENT(codec->events, X264VFW_EV_NAL, X264VFW_EV_BEGIN, 0);
+        pkt->size = x264vfw_copy_annexb(pkt->data, input, size, codec->decoder_nal_length_size);
+        X264VFW_EVENT(codec->events, X264VFW_EV_NAL, X264VFW_EV_END, 0);
+    }
+    else
+    {
+        memcpy(pkt->data, input, size);
+        pkt->size = size;
+    }
+    memset(pkt->data + pkt->size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    codec->stats.bytes_copied += size;
+    return 0;
+}
+
+/* Decode one packet of the stream. Hidden packets may drop non-reference frames, padded ones are
+ * followed by FF_INPUT_BUFFER_PADDING_SIZE zeroed bytes. The picture comes out with the identity as its pkt_pts */
+static int x264vfw_decode_packet(CODEC *codec, uint8_t *input, uint32_t size, int hidden, int padded, uint64_t picture,
+                                 int *got_picture)
+{
+    enum AVDiscard discard;
+    int64_t start;
+    int len, ret;
+
+    /* The decoder doesn't accept new data after it has been drained */
+    if (codec->decoder_draining)
+    {
+        avcodec_flush_buffers(codec->decoder_context);
+        codec->decoder_draining = 0;
+    }
+
+    start = x264vfw_stage_begin(codec, X264VFW_EV_COPY);
+    ret = x264vfw_prepare_packet(codec, input, size, padded);
+    x264vfw_stage_end(codec, X264VFW_EV_COPY, &codec->stats.copy, start);
+    if (ret < 0)
+        return -1;
+
+    /* Dropping non-reference frames is only safe while the pictures come out without delay,
+       otherwise all the following pictures would be shown one frame late */
+    discard = hidden && x264vfw_decoder_get_delay(codec) == 0 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    codec->decoder_context->skip_frame = codec->decoder_keyframe_only ? AVDISCARD_NONKEY : discard;
+    codec->decoder_context->skip_loop_filter = discard;
+
+    /* Remember the in-band SPS for the following ICM_DECOMPRESS_GET_FORMAT */
+    if (!codec->decoder_sps_valid)
+        codec->decoder_sps_valid = x264vfw_hevc_find_sps_annexb(&codec->decoder_sps, codec->decoder_pkt.data, codec->decoder_pkt.size) == 0;
+
+    codec->decoder_pkt.pts = (int64_t)picture;
+    start = x264vfw_stage_begin(codec, X264VFW_EV_DECODE);
+    len = avcodec_decode_video2(codec->decoder_context, codec->decoder_frame, got_picture, &codec->decoder_pkt);
+    x264vfw_stage_end(codec, X264VFW_EV_DECODE, &codec->stats.decode, start);
+    av_buffer_unref(&codec->decoder_pkt.buf);
+    if (len < 0)
+    {
+        DPRINTF("avcodec_decode_video2 failed\n");
+        X264VFW_EVENT_ERROR(codec);
+        return -1;
+    }
+    /* A discarded frame never comes out, don't let it count as delay */
+    if (discard == AVDISCARD_DEFAULT || *got_picture)
+        codec->decoder_frames_in++;
+    codec->stats.frames_in++;
+    if (discard != AVDISCARD_DEFAULT)
+        codec->stats.frames_discard++;
+    return 0;
+}
+
+/* Decode the packets which were skipped because of cache hits so the decoder catches up */
+static int x264vfw_cache_replay(CODEC *codec)
+{
+    int i, got_picture, ret = 0;
+
+    for (i = 0; i < codec->cache_pending_count; i++)
+    {
+        x264vfw_packet_t *pending = &codec->cache_pending[i];
+        if (!ret && x264vfw_decode_packet(codec, pending->data, pending->size, 1, 1, pending->picture, &got_picture) < 0)
+            ret = -1;
+        av_free(pending->data);
+    }
+    codec->cache_pending_count = 0;
+    return ret;
+}
+
+/* A packet failed to decode or its picture is corrupt: an error, or in the resilient mode the
+ * pictures are concealed until the next IRAP picture */
+static int x264vfw_decode_failed(CODEC *codec, uint8_t *output, int width, int height, const x264vfw_rect_t *dst, int hidden)
+{
+    if (!codec->decoder_settings.resilient)
+        return -1;
+    if (!codec->decoder_resync)
+    {
+        DPRINTF("broken reference chain, waiting for the next IRAP picture\n");
+        X264VFW_EVENT(codec->events, X264VFW_EV_RESYNC, X264VFW_EV_INSTANT, 1);
+        codec->decoder_resync = 1;
+    }
+    return x264vfw_conceal_frame(codec, output, width, height, dst, hidden);
+}
+
+/* Start again from an IRAP picture, the pictures still in the decoder depend on the lost data.
+ * The decoder skips the RASL pictures of a CRA by itself after the flush */
+static void x264vfw_resync(CODEC *codec)
+{
+    avcodec_flush_buffers(codec->decoder_context);
+    x264vfw_cache_restart(codec);
+    codec->decoder_frames_in = 0;
+    codec->decoder_draining = 0;
+    codec->decoder_resync = 0;
+    X264VFW_EVENT(codec->events, X264VFW_EV_RESYNC, X264VFW_EV_INSTANT, 0);
+}
+
+/* IDR and BLA pictures, unlike CRA, don't let any later picture reference what came before */
+static int x264vfw_is_random_access(int vcl_type)
+{
+    return vcl_type >= HEVC_NAL_IRAP_FIRST && vcl_type < HEVC_NAL_CRA;
+}
+
+/* A picture depends on the packets since the last IRAP picture, so its identity chains their hashes. The RASL
+ * pictures of a CRA also depend on the packets before it. The picture which comes out for a packet depends on
+ * the packet and on the pictures waiting in the decoder (the reordering, the frame threads), so the key adds
+ * those and the output format. Returns the key and the identity of the picture of the packet */
+static uint64_t x264vfw_cache_key(CODEC *codec, uint8_t *input, uint32_t size, int vcl_type,
+                                  int width, int height, const x264vfw_rect_t *src, uint64_t *picture)
+{
+    int format[] = { codec->decoder_pix_fmt, codec->decoder_vflip, codec->decoder_swap_UV, width, height,
+                     src->x, src->y, src->width, src->height };
+
+    if (vcl_type == HEVC_NAL_CRA)
+        codec->cache_cra_chain = codec->cache_chain;
+    else if (x264vfw_is_random_access(vcl_type))
+        codec->cache_cra_chain = 0;
+    if (vcl_type >= HEVC_NAL_IRAP_FIRST && vcl_type <= HEVC_NAL_CRA)
+        codec->cache_chain = 0;
+    codec->cache_chain = x264vfw_hash(input, size, codec->cache_chain);
+
+    *picture = codec->cache_chain;
+    if (vcl_type == HEVC_NAL_RASL_N || vcl_type == HEVC_NAL_RASL_R)
+        *picture = x264vfw_hash((uint8_t *)&codec->cache_cra_chain, sizeof(codec->cache_cra_chain), *picture);
+    return x264vfw_hash((uint8_t *)format, sizeof(format),
+                        x264vfw_hash((uint8_t *)&codec->cache_inflight, sizeof(codec->cache_inflight), *picture));
+}
+
+/* Serve the picture from the cache without decoding. The packet is kept to be decoded
+ * before the next miss, the pictures it leaves in the decoder are taken from the cache. Returns 0 on a hit */
+static int x264vfw_cache_lookup(CODEC *codec, uint64_t key, uint64_t picture, int vcl_type, uint8_t *input, uint32_t size,
+                                uint8_t *output, int picture_size, int hidden)
+{
+    x264vfw_packet_t *pending;
+
+    if (x264vfw_cache_get(codec->cache, key, hidden ? NULL : output, picture_size, &codec->cache_inflight) < 0)
+        return -1;
+
+    /* Nothing before a random access point is needed anymore, unless its pictures are still to come out */
+    if (x264vfw_is_random_access(vcl_type) && !codec->cache_inflight)
+        x264vfw_cache_clear_pending(codec);
+    if (codec->cache_pending_count == X264VFW_CACHE_MAX_PENDING && x264vfw_cache_replay(codec) < 0)
+        return -1;
+
+    pending = &codec->cache_pending[codec->cache_pending_count];
+    /* Padded, so x264vfw_cache_replay decodes it without another copy */
+    pending->data = size <= INT_MAX - FF_INPUT_BUFFER_PADDING_SIZE ? av_malloc(size + FF_INPUT_BUFFER_PADDING_SIZE) : NULL;
+    if (!pending->data)
+    {
+        /* Catch up now, the packet will be decoded the normal way */
+        x264vfw_cache_replay(codec);
+        return -1;
+    }
+    memcpy(pending->data, input, size);
+    memset(pending->data + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    pending->size = size;
+    pending->picture = picture;
+    codec->cache_pending_count++;
+    if (hidden)
+        codec->stats.frames_hidden++;
+    return 0;
+}
+
+static int x264vfw_decode(CODEC *codec, uint8_t *input, uint32_t size, uint8_t *output, int width, int height,
+                          const x264vfw_rect_t *src, const x264vfw_rect_t *dst, int flags)
+{
+    int hidden = (flags & X264VFW_DECODE_HIDDEN) != 0;
+    int got_picture, ret;
+    int64_t start;
+    int picture_size = x264vfw_picture_get_size(codec->decoder_pix_fmt, width, height);
+    int full = dst->width == width && dst->height == height;
+    int cached = codec->cache && !codec->decoder_keyframe_only && full;
+    uint64_t cache_key = 0, picture_id = 0;
+    AVPicture picture;
+
+    if (picture_size < 0)
+    {
+        DPRINTF("x264vfw_picture_get_size failed\n");
+        X264VFW_EVENT_ERROR(codec);
+        return -1;
+    }
+
+    got_picture = 0;
+    if (!size)
+    {
+        AVPacket pkt;
+
+        cached = 0;
+        if (x264vfw_cache_replay(codec) < 0)
+            return -1;
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        start = x264vfw_stage_begin(codec, X264VFW_EV_DECODE);
+        ret = avcodec_decode_video2(codec->decoder_context, codec->decoder_frame, &got_picture, &pkt);
+        x264vfw_stage_end(codec, X264VFW_EV_DECODE, &codec->stats.decode, start);
+        if (ret < 0)
+        {
+            DPRINTF("avcodec_decode_video2 failed\n");
+            X264VFW_EVENT_ERROR(codec);
+            return -1;
+        }
+        codec->decoder_draining = 1;
+    }
+    else
+    {
+        /* Without extradata look at the first packet only */
+        if (codec->decoder_nal_length_size < 0)
+            codec->decoder_nal_length_size = x264vfw_is_size_prefixed(input, size) ? 4 : 0;
+
+        /* Non-key frames are not even looked at by the decoder */
+        if (codec->decoder_keyframe_only &&
+            ((flags & X264VFW_DECODE_NOTKEY) || !x264vfw_hevc_is_irap(input, size, codec->decoder_nal_length_size)))
+            return x264vfw_show_held_frame(codec, output, width, height, dst, hidden);
+
+        /* The bitstream decides, containers of live streams don't always flag the CRA pictures */
+        if (codec->decoder_resync)
+        {
+            if (!x264vfw_hevc_is_irap(input, size, codec->decoder_nal_length_size))
+                return x264vfw_conceal_frame(codec, output, width, height, dst, hidden);
+            x264vfw_resync(codec);
+        }
+
+        if (codec->cache && !codec->decoder_keyframe_only)
+        {
+            int vcl_type = x264vfw_hevc_first_vcl_type(input, size, codec->decoder_nal_length_size);
+            /* A drained decoder is flushed before the packet */
+            if (codec->decoder_draining)
+                codec->cache_inflight = 0;
+            cache_key = x264vfw_cache_key(codec, input, size, vcl_type, width, height, src, &picture_id);
+            if (cached)
+            {
+                int hit;
+                start = x264vfw_stage_begin(codec, X264VFW_EV_COPY);
+                hit = x264vfw_cache_lookup(codec, cache_key, picture_id, vcl_type, input, size, output, picture_size,
+                                           hidden) == 0;
+                x264vfw_stage_end(codec, X264VFW_EV_COPY, &codec->stats.copy, start);
+                if (hit)
+                {
+                    codec->decoder_shown |= !hidden;
+                    return 0;
+                }
+            }
+            if (x264vfw_cache_replay(codec) < 0)
+                return x264vfw_decode_failed(codec, output, width, height, dst, hidden);
+        }
+
+        if (x264vfw_decode_packet(codec, input, size, hidden, 0, picture_id, &got_picture) < 0)
+            return x264vfw_decode_failed(codec, output, width, height, dst, hidden);
+
+        /* The pictures waiting in the decoder after the packet, nothing waits without delay (a dropped
+         * or skipped picture never comes out) */
+        if (codec->cache && !codec->decoder_keyframe_only)
+        {
+            codec->cache_inflight += picture_id;
+            if (got_picture)
+                codec->cache_inflight -= (uint64_t)codec->decoder_frame->pkt_pts;
+            if (x264vfw_decoder_get_delay(codec) == 0)
+                codec->cache_inflight = 0;
+        }
+
+        /* Keyframes must not wait for the following (skipped) frames to be reordered */
+        if (codec->decoder_keyframe_only && !got_picture)
+        {
+            AVPacket pkt;
+
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+            start = x264vfw_stage_begin(codec, X264VFW_EV_DECODE);
+            if (avcodec_decode_video2(codec->decoder_context, codec->decoder_frame, &got_picture, &pkt) < 0)
+                got_picture = 0;
+            x264vfw_stage_end(codec, X264VFW_EV_DECODE, &codec->stats.decode, start);
+            codec->decoder_draining = 1;
+        }
+    }
+
+    if (got_picture && codec->decoder_delay < 0)
+    {
+        /* Frames which went in before the first picture came out */
+        codec->decoder_delay = X264VFW_MAX(codec->decoder_frames_in - 1, 0);
+        DPRINTF("decoder delay: %d frame(s)\n", codec->decoder_delay);
+        if (codec->decoder_delay > x264vfw_decoder_get_expected_delay(codec))
+            DPRINTF("decoder delay exceeds the expected %d frame(s)\n", x264vfw_decoder_get_expected_delay(codec));
+    }
+    if (got_picture)
+        codec->stats.frames_out++;
+    if (got_picture && codec->decoder_settings.resilient &&
+        (codec->decoder_frame->decode_error_flags || (codec->decoder_frame->flags & AV_FRAME_FLAG_CORRUPT)))
+        return x264vfw_decode_failed(codec, output, width, height, dst, hidden);
+    /* Also the pictures delayed after a resync, so the last good one stays instead of black */
+    if (!got_picture && codec->decoder_settings.resilient && codec->decoder_shown)
+        return x264vfw_conceal_frame(codec, output, width, height, dst, hidden);
+
+    if (hidden)
+    {
+        /* No conversion and no BLACK-frame */
+        codec->stats.frames_hidden++;
+        return 0;
+    }
+
+    if (!got_picture && full)
+    {
+        /* Frame was decoded but delayed so we would show the BLACK-frame instead */
+        x264vfw_fill_black_frame(output, codec->decoder_pix_fmt, picture_size);
+        codec->stats.frames_black++;
+        X264VFW_EVENT(codec->events, X264VFW_EV_BLACK, X264VFW_EV_INSTANT, 0);
+        return 0;
+    }
+
+    if (x264vfw_output_picture(codec, &picture, output, width, height, dst) < 0)
+        return -1;
+
+    if (!got_picture)
+    {
+        x264vfw_fill_black_rect(&picture, codec->decoder_pix_fmt, dst->width, dst->height);
+        codec->stats.frames_black++;
+        X264VFW_EVENT(codec->events, X264VFW_EV_BLACK, X264VFW_EV_INSTANT, 0);
+        return 0;
+    }
+
+    start = x264vfw_stage_begin(codec, X264VFW_EV_CONVERT);
+    ret = x264vfw_convert_picture(codec, &picture, src, dst);
+    x264vfw_stage_end(codec, X264VFW_EV_CONVERT, &codec->stats.convert, start);
+    if (ret < 0)
+        return -1;
+
+    if (cached)
+        x264vfw_cache_put(codec->cache, cache_key, output, picture_size, codec->cache_inflight);
+    codec->decoder_shown = 1;
+
+    /* Keep the converted keyframe for the following non-key frames, or the picture to conceal the lost ones */
+    if ((codec->decoder_keyframe_only || codec->decoder_settings.resilient == X264VFW_RESILIENT_COPY) && full)
+    {
+        if (codec->decoder_held_size != picture_size)
+        {
+            av_freep(&codec->decoder_held);
+            codec->decoder_held_size = 0;
+            codec->decoder_held = av_malloc(picture_size);
+            if (codec->decoder_held)
+                codec->decoder_held_size = picture_size;
+        }
+        if (codec->decoder_held)
+            memcpy(codec->decoder_held, output, picture_size);
+    }
+
+    return 0;
+}
+
+int x264vfw_decoder_decode(CODEC *codec, uint8_t *input, uint32_t size, uint8_t *output, int width, int height,
+                           const x264vfw_rect_t *src, const x264vfw_rect_t *dst, int flags)
+{
+    int ret;
+
+    X264VFW_EVENT(codec->events, X264VFW_EV_FRAME, X264VFW_EV_BEGIN, 0);
+    ret = x264vfw_decode(codec, input, size, output, width, height, src, dst, flags);
+    X264VFW_EVENT(codec->events, X264VFW_EV_FRAME, X264VFW_EV_END, 0);
+    return ret;
+}
+
+int x264vfw_decoder_get_delay(CODEC *codec)
+{
+    if (!codec->decoder_context)
+        return 0;
+    if (codec->decoder_delay >= 0)
+        return codec->decoder_delay;
+
+    /* Not measured yet, predict it from the reorder depth and the frame threads */
+    return x264vfw_decoder_get_expected_delay(codec);
+}
+
+void x264vfw_decoder_set_keyframe_only(CODEC *codec, int enable)
+{
+    codec->decoder_keyframe_only = enable != 0;
+    if (!codec->decoder_keyframe_only && codec->decoder_settings.resilient != X264VFW_RESILIENT_COPY)
+    {
+        /* The next non-key frame may miss its references until the host seeks to a keyframe */
+        av_freep(&codec->decoder_held);
+        codec->decoder_held_size = 0;
+    }
+}
+
+void x264vfw_decoder_set_settings(CODEC *codec, const x264vfw_settings_t *settings)
+{
+    codec->settings = *settings;
+    x264vfw_settings_validate(&codec->settings);
+    x264vfw_decoder_set_keyframe_only(codec, codec->settings.keyframe_only);
+}
+
+int x264vfw_decoder_get_cache_stats(CODEC *codec, x264vfw_cache_stats_t *stats)
+{
+    if (!codec->cache)
+        return -1;
+    x264vfw_cache_get_stats(codec->cache, stats);
+    return 0;
+}
+
+void x264vfw_decoder_get_stats(CODEC *codec, x264vfw_stats_t *stats)
+{
+    *stats = codec->stats;
+}
+
+void x264vfw_decoder_end(CODEC *codec)
+{
+    x264vfw_stats_t *stats = &codec->stats;
+
+    /* The counters go on from DRV_OPEN, see x264vfw_decoder_get_stats */
+    if (stats->bytes_in)
+        DPRINTF("input: %.1f MB, copied: %.1f MB\n", stats->bytes_in / 1048576.0, stats->bytes_copied / 1048576.0);
+    if (stats->frames_in)
+        DPRINTF("frames: %u in, %u out, %u black; time: copy %.1f ms, decode %.1f ms (max %.1f), convert %.1f ms (max %.1f)\n",
+                stats->frames_in, stats->frames_out, stats->frames_black, stats->copy.total / 1000.0,
+                stats->decode.total / 1000.0, stats->decode.max / 1000.0, stats->convert.total / 1000.0, stats->convert.max / 1000.0);
+    if (stats->frames_hidden)
+        DPRINTF("hurry-up/preroll frames: %u, non-reference frames discarded: %u\n", stats->frames_hidden, stats->frames_discard);
+    if (stats->frames_nonkey)
+        DPRINTF("non-key frames skipped: %u\n", stats->frames_nonkey);
+    if (stats->frames_concealed)
+        DPRINTF("frames concealed: %u\n", stats->frames_concealed);
+    av_freep(&codec->decoder_held);
+    codec->decoder_held_size = 0;
+    if (codec->cache)
+    {
+        x264vfw_cache_stats_t cache_stats;
+        x264vfw_cache_get_stats(codec->cache, &cache_stats);
+        DPRINTF("cache: %u hits, %u misses, %u evictions\n", cache_stats.hits, cache_stats.misses, cache_stats.evictions);
+    }
+    if (codec->framepool)
+    {
+        x264vfw_framepool_stats_t pool_stats;
+        x264vfw_framepool_get_stats(codec->framepool, &pool_stats);
+        DPRINTF("frame pool: %d of %d frames of %d bytes, high-water mark %d, fallbacks: %u\n",
+                pool_stats.frames, pool_stats.frames_max, pool_stats.frame_size, pool_stats.high_water, pool_stats.fallbacks);
+    }
+    x264vfw_cache_clear_pending(codec);
+    /* The decoder, the converter and the thread pool are kept for the next start, see x264vfw_decoder_close */
+}
+
+void x264vfw_decoder_close(CODEC *codec)
+{
+    x264vfw_decoder_end(codec);
+    if (codec->stats.decoder_restarts)
+        DPRINTF("decoder opens: %u, warm restarts: %u\n", codec->stats.decoder_opens, codec->stats.decoder_restarts);
+    x264vfw_cache_delete(codec->cache);
+    codec->cache = NULL;
+    if (codec->decoder_context)
+        avcodec_close(codec->decoder_context);
+    av_freep(&codec->decoder_context);
+    av_frame_free(&codec->decoder_frame);
+    codec->decoder_sps_valid = 0;
+    codec->decoder_pps_valid = 0;
+    /* After the decoder, the frames which are still referenced free the pool later */
+    x264vfw_framepool_delete(codec->framepool);
+    codec->framepool = NULL;
+    av_freep(&codec->decoder_extradata);
+    av_buffer_pool_uninit(&codec->decoder_pkt_pool);
+    codec->decoder_pkt_pool_size = 0;
+    x264vfw_free_sws(codec);
+    av_freep(&codec->tonemap);
+    codec->threadpool = NULL;
+    x264vfw_budget_leave(codec);
+}
@@ -0,0 +1,180 @@
+/*****************************************************************************
+ * decoder.h: VFW independent decoding pipeline
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_DECODER_H
+#define X264VFW_DECODER_H
+
+#include "common.h"
+
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+
+#include "cache.h"
+#include "cpu.h"
+#include "csp.h"
+#include "events.h"
+#include "framepool.h"
+#include "hevc.h"
+#include "settings.h"
+#include "stats.h"
+#include "thread.h"
+#include "trace.h"
+
+/* x264vfw_decoder_open errors */
+#define X264VFW_DECODER_ERROR     -1
+#define X264VFW_DECODER_BADFORMAT -2
+
+/* x264vfw_decoder_decode flags */
+#define X264VFW_DECODE_HIDDEN 0x0001 /* the picture won't be shown, only the decoder state matters */
+#define X264VFW_DECODE_NOTKEY 0x0002 /* the container says it is not a keyframe */
+
+/* Compressed packet owned by the codec, followed by FF_INPUT_BUFFER_PADDING_SIZE zeroed bytes */
+typedef struct
+{
+    uint8_t  *data;
+    uint32_t size;
+    uint64_t picture;  /* identity of its picture, see x264vfw_cache_key */
+} x264vfw_packet_t;
+
+/* Decoded frame and conversion the swscale contexts are built for, compared at every frame so
+ * a stream which changes its size or format midway gets new contexts */
+typedef struct
+{
+    int src_width;
+    int src_height;
+    int src_format;
+    int src_range;
+    int src_colorspace;
+    int width;
+    int height;
+} x264vfw_sws_key_t;
+
+/* CODEC: decoder instance, the VFW driver keeps one per opened driver handle */
+typedef struct
+{
+    /* Decoder */
+    int                decoder_nal_length_size; /* 0 - Annex B, 1/2/4 - size prefixed NAL units, -1 - unknown */
+    AVCodec            *decoder;
+    AVCodecContext     *decoder_context;
+    AVFrame            *decoder_frame;
+    void               *decoder_extradata;
+    x264vfw_framepool_t *framepool;       /* decoded pictures, NULL - the default allocator */
+    AVBufferPool       *decoder_pkt_pool;  /* padded refcounted packet buffers */
+    uint32_t           decoder_pkt_pool_size;
+    int                decoder_keyframe_only;
+    x264vfw_settings_t settings;               /* for the next open */
+    x264vfw_settings_t decoder_settings;       /* of the open decoder */
+    void               *decoder_held;          /* last converted keyframe, or good picture in the resilient mode */
+    int                decoder_held_size;
+    void               *decoder_format_in;     /* BITMAPINFOHEADER and extradata of the last BEGIN, owned by the VFW adapter */
+    void               *decoder_format_out;
+    unsigned int       instance;               /* of the driver in the process, names the files below */
+    x264vfw_trace_t    *trace;                 /* recorded ICM calls, owned by the VFW adapter */
+    FILE               *stats_file;            /* periodic dumps of the stats, owned by the VFW adapter */
+    int64_t            stats_next;
+    x264vfw_events_t   *events;                /* runtime event trace, NULL - off, owned by the VFW adapter */
+    AVPacket           decoder_pkt;
+    int                decoder_mode;
+    int                decoder_threads;        /* settings.threads or the share of the process thread budget */
+    int                decoder_budget_joined;
+    int                decoder_frames_in;      /* since the last start, for the delay */
+    x264vfw_stats_t    stats;
+    int                decoder_delay;     /* measured output delay in frames, -1 if unknown */
+    int                decoder_draining;
+    int                decoder_resync;         /* resilient mode: nothing is decoded until the next IRAP picture */
+    int                decoder_shown;          /* a picture was converted since the last start */
+    x264vfw_hevc_sps_t decoder_sps;
+    int                decoder_sps_valid;
+    x264vfw_hevc_pps_t decoder_pps;
+    int                decoder_pps_valid;
+    enum AVPixelFormat decoder_pix_fmt;
+    int                decoder_vflip;
+    int                decoder_swap_UV;
+    int                decoder_width;          /* of the stream at the open, the source rectangles are in its coordinates */
+    int                decoder_height;
+    struct SwsContext  *sws;                   /* converts the whole picture, it isn't split into bands */
+    x264vfw_sws_key_t  sws_key;                /* what the context was built for */
+    x264vfw_csp_function_t csp;
+    x264vfw_tonemap_t  *tonemap;               /* tables of the last HDR stream converted to RGB, NULL - none yet */
+
+    /* Cache of converted pictures */
+    x264vfw_cache_t    *cache;
+    uint64_t           cache_chain;            /* hash of the packets since the last IRAP picture */
+    uint64_t           cache_cra_chain;        /* cache_chain before the last CRA picture, its RASL pictures depend on it */
+    uint64_t           cache_inflight;         /* sum of the identities of the pictures which are in the decoder
+                                                * and didn't come out yet */
+    x264vfw_packet_t   cache_pending[X264VFW_CACHE_MAX_PENDING]; /* skipped by cache hits, not decoded yet */
+    int                cache_pending_count;
+
+    /* Band-parallel colorspace conversion */
+    int                  convert_threads;
+    x264vfw_threadpool_t *threadpool;  /* shared by the process, not owned */
+} CODEC;
+
+/* Rectangle of the picture in pixels, (x, y) is the top left corner */
+typedef struct
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} x264vfw_rect_t;
+
+/* Process-wide state, x264vfw_CS must be initialized before */
+void x264vfw_decoder_load(void);
+void x264vfw_decoder_unload(void);
+
+/* Open the decoder for a width x height stream and the output csp (X264VFW_CSP_*, optionally with
+ * X264VFW_CSP_VFLIP). The extradata may be an hvcC record or Annex B parameter sets */
+int  x264vfw_decoder_open(CODEC *codec, int width, int height, uint32_t fourcc,
+                          const uint8_t *extradata, int extradata_size, int csp);
+/* Flush the decoder to start again with the same format. Returns -1 if it must be opened again */
+int  x264vfw_decoder_restart(CODEC *codec);
+/* Decode one access unit (size 0 drains the delayed pictures) into the dst rectangle of the
+ * width x height output bitmap, the src rectangle of the picture is used */
+int  x264vfw_decoder_decode(CODEC *codec, uint8_t *input, uint32_t size, uint8_t *output, int width, int height,
+                            const x264vfw_rect_t *src, const x264vfw_rect_t *dst, int flags);
+/* Log the statistics, which keep counting from DRV_OPEN, the decoder stays open */
+void x264vfw_decoder_end(CODEC *codec);
+void x264vfw_decoder_close(CODEC *codec);
+
+int  x264vfw_decoder_get_delay(CODEC *codec);
+/* Output delay which the stream and the threading mode should give, the measured one must not exceed it */
+int  x264vfw_decoder_get_expected_delay(CODEC *codec);
+void x264vfw_decoder_set_keyframe_only(CODEC *codec, int enable);
+/* keyframe_only applies at once, the rest at the next open: a restart fails if they changed */
+void x264vfw_decoder_set_settings(CODEC *codec, const x264vfw_settings_t *settings);
+int  x264vfw_decoder_get_cache_stats(CODEC *codec, x264vfw_cache_stats_t *stats);
+void x264vfw_decoder_get_stats(CODEC *codec, x264vfw_stats_t *stats);
+
+/* Output layouts which libavutil has no pixel format for, only x264vfw_yuv2hbd writes them */
+#define X264VFW_PIX_FMT_V210 ((enum AVPixelFormat)(AV_PIX_FMT_NB + 1))
+#define X264VFW_PIX_FMT_Y410 ((enum AVPixelFormat)(AV_PIX_FMT_NB + 2))
+#define X264VFW_PIX_FMT_Y416 ((enum AVPixelFormat)(AV_PIX_FMT_NB + 3))
+#define X264VFW_PIX_FMT_IS_PACKED_HBD(pix_fmt) ((pix_fmt) > AV_PIX_FMT_NB)
+
+/* Output picture layout */
+enum AVPixelFormat x264vfw_csp_to_pix_fmt(int i_csp);
+int x264vfw_picture_get_size(enum AVPixelFormat pix_fmt, int width, int height);
+
+/* Process-wide lock */
+extern x264vfw_mutex_t x264vfw_CS;
+
+#endif
@@ -24,12 +24,17 @@
 
 #include "x265vfw.h"
 
+#include <shellapi.h>
+
 #ifdef PTW32_STATIC_LIB
 #include <pthread.h>
 #endif
 
 /* Global DLL critical section */
-CRITICAL_SECTION x264vfw_CS;
+x264vfw_mutex_t x264vfw_CS;
+
+/* Messages of libav, shared by the event traces of all the instances */
+static x264vfw_events_t *x264vfw_log_events;
 
 BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
 {
@@ -37,7 +42,7 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
     switch (fdwReason)
     {
         case DLL_PROCESS_ATTACH:
-            InitializeCriticalSection(&x264vfw_CS);
+            x264vfw_mutex_init(&x264vfw_CS);
             pthread_win32_process_attach_np();
             pthread_win32_thread_attach_np();
             break;
@@ -53,18 +58,18 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
         case DLL_PROCESS_DETACH:
             pthread_win32_thread_detach_np();
             pthread_win32_process_detach_np();
-            DeleteCriticalSection(&x264vfw_CS);
+            x264vfw_mutex_destroy(&x264vfw_CS);
             break;
     }
 #else
     switch (fdwReason)
     {
         case DLL_PROCESS_ATTACH:
-            InitializeCriticalSection(&x264vfw_CS);
+            x264vfw_mutex_init(&x264vfw_CS);
             break;
 
         case DLL_PROCESS_DETACH:
-            DeleteCriticalSection(&x264vfw_CS);
+            x264vfw_mutex_destroy(&x264vfw_CS);
             break;
     }
 #endif
@@ -74,29 +79,197 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
 
 static void log_callback(void *ptr, int level, const char *fmt, va_list vl)
 {
-    if (level <= av_log_get_level())
-        DVPRINTF(fmt, vl);
+    if (level > av_log_get_level())
+        return;
+#if X264VFW_EVENTS
+    if (x264vfw_log_events)
+    {
+        va_list copy;
+        va_copy(copy, vl);
+        x264vfw_event_message(x264vfw_log_events, fmt, copy);
+        va_end(copy);
+    }
+#endif
+    DVPRINTF(fmt, vl);
+}
+
+static void x264vfw_instance_filename(char *filename, int size, const char *prefix, unsigned int instance, const char *ext)
+{
+    snprintf(filename, size, "%s-%lu-%u.%s", prefix, (unsigned long)GetCurrentProcessId(), instance, ext);
 }
 
-/* This little puppy handles the calls which VFW programs send out to the codec */
-LRESULT WINAPI attribute_align_arg DriverProc(DWORD_PTR dwDriverId, HDRVR hDriver, UINT uMsg, LPARAM lParam1, LPARAM lParam2)
+/* Opt-in recording of the decompression calls (to replay the session of a host offline)
+   and periodic dumps of the stats, both are named after the process and the driver instance */
+static void x264vfw_instance_open(CODEC *codec)
+{
+    static unsigned int instances;
+    const char *record = getenv(X264VFW_RECORD_ENV);
+    const char *stats = getenv(X264VFW_STATS_ENV);
+    const char *events = X264VFW_EVENTS ? getenv(X264VFW_EVENTS_ENV) : NULL;
+    char filename[MAX_PATH];
+    unsigned int instance;
+
+    if ((!record || !*record) && (!stats || !*stats) && (!events || !*events))
+        return;
+
+    x264vfw_mutex_lock(&x264vfw_CS);
+    instance = instances++;
+    x264vfw_mutex_unlock(&x264vfw_CS);
+    codec->instance = instance;
+
+    if (record && *record)
+    {
+        x264vfw_instance_filename(filename, sizeof(filename), record, instance, "trace");
+        if (x264vfw_trace_create(&codec->trace, filename) == 0)
+            DPRINTF("recording to %s\n", filename);
+    }
+    if (stats && *stats)
+    {
+        x264vfw_instance_filename(filename, sizeof(filename), stats, instance, "json");
+        if ((codec->stats_file = fopen(filename, "w")))
+            DPRINTF("stats to %s\n", filename);
+        else
+            DPRINTF("can't create %s\n", filename);
+    }
+    if (events && *events)
+        x264vfw_events_init(&codec->events, X264VFW_EVENTS_SIZE);
+}
+
+static LRESULT x264vfw_events_flush(CODEC *codec)
+{
+    char filename[MAX_PATH];
+
+    if (!codec->events)
+        return ICERR_UNSUPPORTED;
+    x264vfw_instance_filename(filename, sizeof(filename), getenv(X264VFW_EVENTS_ENV), codec->instance, "events.json");
+    if (x264vfw_events_write_json(filename, codec->events, x264vfw_log_events, (int)GetCurrentProcessId()) < 0)
+        return ICERR_ERROR;
+    return ICERR_OK;
+}
+
+static void x264vfw_instance_close(CODEC *codec)
+{
+    if (codec->events)
+    {
+        x264vfw_events_flush(codec);
+        x264vfw_events_delete(codec->events);
+        codec->events = NULL;
+    }
+    x264vfw_trace_close(codec->trace);
+    codec->trace = NULL;
+    if (codec->stats_file)
+    {
+        /* The last line has the totals of the instance */
+        x264vfw_stats_write_json(codec->stats_file, &codec->stats, x264vfw_mdate());
+        fclose(codec->stats_file);
+        codec->stats_file = NULL;
+    }
+}
+
+static void x264vfw_stats_poll(CODEC *codec)
+{
+    int64_t now = x264vfw_mdate();
+
+    if (now < codec->stats_next)
+        return;
+    x264vfw_stats_write_json(codec->stats_file, &codec->stats, now);
+    fflush(codec->stats_file);
+    codec->stats_next = now + X264VFW_STATS_INTERVAL * 1000LL;
+}
+
+static void x264vfw_ini_filename(char *filename, int size)
+{
+    const char *ini = getenv(X264VFW_INI_ENV);
+    const char *appdata = getenv("APPDATA");
+
+    if (ini && *ini)
+        snprintf(filename, size, "%s", ini);
+    else if (appdata && *appdata)
+        snprintf(filename, size, "%s\\%s", appdata, X264VFW_INI_NAME);
+    else
+        snprintf(filename, size, "%s", X264VFW_INI_NAME);
+}
+
+/* For the hosts which never restore a state with ICM_SETSTATE */
+static void x264vfw_settings_load(x264vfw_settings_t *settings)
+{
+    char filename[MAX_PATH];
+
+    x264vfw_settings_default(settings);
+    x264vfw_ini_filename(filename, sizeof(filename));
+    if (x264vfw_settings_read_ini(settings, filename) == 0)
+        DPRINTF("settings from %s\n", filename);
+    x264vfw_settings_read_env(settings);
+    x264vfw_settings_validate(settings);
+}
+
+/* There is no dialog: the settings of the driver (or those which the next one gets) are written
+   to the INI file and opened in the editor of the user, they apply to the drivers opened next */
+static int x264vfw_configure(HWND hwnd, CODEC *codec)
+{
+    x264vfw_settings_t settings;
+    char filename[MAX_PATH];
+
+    if (codec)
+        settings = codec->settings;
+    else
+        x264vfw_settings_load(&settings);
+    x264vfw_ini_filename(filename, sizeof(filename));
+    if (x264vfw_settings_write_ini(&settings, filename) < 0)
+        return -1;
+    if ((INT_PTR)ShellExecuteA(hwnd, "open", filename, NULL, NULL, SW_SHOWNORMAL) <= 32)
+    {
+        DPRINTF("can't open %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+/* The decompression messages and those which change how the next frames are decoded */
+static int x264vfw_is_recorded(UINT uMsg)
+{
+    switch (uMsg)
+    {
+        case ICM_DECOMPRESS_GET_FORMAT:
+        case ICM_DECOMPRESS_QUERY:
+        case ICM_DECOMPRESS_BEGIN:
+        case ICM_DECOMPRESS:
+        case ICM_DECOMPRESS_END:
+        case ICM_DECOMPRESSEX_QUERY:
+        case ICM_DECOMPRESSEX_BEGIN:
+        case ICM_DECOMPRESSEX:
+        case ICM_DECOMPRESSEX_END:
+        case ICM_X264VFW_SET_KEYFRAME_ONLY:
+        case ICM_SETSTATE:
+            return 1;
+    }
+    return 0;
+}
+
+static LRESULT x264vfw_driver_proc(DWORD_PTR dwDriverId, HDRVR hDriver, UINT uMsg, LPARAM lParam1, LPARAM lParam2)
 {
     CODEC *codec = (CODEC *)dwDriverId;
-    ICDECOMPRESSEX *px;
 
     switch (uMsg)
     {
         case DRV_LOAD:
             avcodec_register_all();
             av_log_set_callback(log_callback);
+            x264vfw_decoder_load();
+            if (X264VFW_EVENTS && getenv(X264VFW_EVENTS_ENV) && *getenv(X264VFW_EVENTS_ENV) && !x264vfw_log_events)
+                x264vfw_events_init(&x264vfw_log_events, X264VFW_EV_MESSAGES);
             return DRV_OK;
 
         case DRV_FREE:
+            x264vfw_decoder_unload();
+            x264vfw_events_delete(x264vfw_log_events);
+            x264vfw_log_events = NULL;
             return DRV_OK;
 
         case DRV_OPEN:
         {
             ICOPEN *icopen = (ICOPEN *)lParam2;
+            x264vfw_settings_t settings;
 
             if (icopen && icopen->fccType != ICTYPE_VIDEO)
                 return 0;
@@ -109,6 +282,9 @@ LRESULT WINAPI attribute_align_arg DriverProc(DWORD_PTR dwDriverId, HDRVR hDrive
             }
 
             memset(codec, 0, sizeof(CODEC));
+            x264vfw_settings_load(&settings);
+            x264vfw_decoder_set_settings(codec, &settings);
+            x264vfw_instance_open(codec);
 
             if (icopen)
                 icopen->dwError = ICERR_OK;
@@ -116,16 +292,18 @@ LRESULT WINAPI attribute_align_arg DriverProc(DWORD_PTR dwDriverId, HDRVR hDrive
         }
 
         case DRV_CLOSE:
-            /* From xvid: x264vfw_compress_end/x264vfw_decompress_end don't always get called */
-            x264vfw_decompress_end(codec);
+            /* From xvid: x264vfw_compress_end/x264vfw_decompress_end don't always get called,
+               and the decoder outlives ICM_DECOMPRESS_END anyway */
+            x264vfw_decompress_close(codec);
+            x264vfw_instance_close(codec);
             free(codec);
             return DRV_OK;
 
         case DRV_QUERYCONFIGURE:
-            return 0;
+            return DRV_OK;
 
         case DRV_CONFIGURE:
-            return DRV_CANCEL;
+            return x264vfw_configure((HWND)lParam1, codec) == 0 ? DRV_OK : DRV_CANCEL;
 
 /*
         case DRV_DISABLE:
@@ -138,11 +316,25 @@ LRESULT WINAPI attribute_align_arg DriverProc(DWORD_PTR dwDriverId, HDRVR hDrive
 */
 
         /* ICM */
+        case ICM_CONFIGURE:
+            /* -1 only asks whether there is a configuration */
+            if (lParam1 == -1)
+                return ICERR_OK;
+            return x264vfw_configure((HWND)lParam1, codec) == 0 ? ICERR_OK : ICERR_ERROR;
+
         case ICM_GETSTATE:
-            return ICERR_OK;
+            return x264vfw_decompress_get_state(codec, (void *)lParam1, (DWORD)lParam2);
 
         case ICM_SETSTATE:
-            return 0;
+            /* No state: back to the INI file and the environment */
+            if (!(void *)lParam1)
+            {
+                x264vfw_settings_t settings;
+                x264vfw_settings_load(&settings);
+                x264vfw_decoder_set_settings(codec, &settings);
+                return 0;
+            }
+            return x264vfw_decompress_set_state(codec, (const void *)lParam1, (DWORD)lParam2);
 
         case ICM_GETINFO:
         {
@@ -193,12 +385,10 @@ LRESULT WINAPI attribute_align_arg DriverProc(DWORD_PTR dwDriverId, HDRVR hDrive
             return x264vfw_decompress_end(codec);
 
         case ICM_DECOMPRESSEX_QUERY:
-            px = (ICDECOMPRESSEX *)lParam1;
-            return x264vfw_decompress_query(codec, (BITMAPINFO *)px->lpbiSrc, (BITMAPINFO *)px->lpbiDst);
+            return x264vfw_decompress_query_ex(codec, (ICDECOMPRESSEX *)lParam1);
 
         case ICM_DECOMPRESSEX_BEGIN:
-            px = (ICDECOMPRESSEX *)lParam1;
-            return x264vfw_decompress_begin(codec, (BITMAPINFO *)px->lpbiSrc, (BITMAPINFO *)px->lpbiDst);
+            return x264vfw_decompress_begin_ex(codec, (ICDECOMPRESSEX *)lParam1);
 
         case ICM_DECOMPRESSEX:
             return x264vfw_decompress_ex(codec, (ICDECOMPRESSEX *)lParam1);
@@ -206,6 +396,22 @@ LRESULT WINAPI attribute_align_arg DriverProc(DWORD_PTR dwDriverId, HDRVR hDrive
         case ICM_DECOMPRESSEX_END:
             return x264vfw_decompress_end(codec);
 
+        /* Private */
+        case ICM_X264VFW_GET_DELAY:
+            return x264vfw_decompress_get_delay(codec);
+
+        case ICM_X264VFW_SET_KEYFRAME_ONLY:
+            return x264vfw_decompress_set_keyframe_only(codec, (int)lParam1);
+
+        case ICM_X264VFW_GET_CACHE_STATS:
+            return x264vfw_decompress_get_cache_stats(codec, (x264vfw_cache_stats_t *)lParam1, (DWORD)lParam2);
+
+        case ICM_X264VFW_GET_STATS:
+            return x264vfw_decompress_get_stats(codec, (x264vfw_stats_t *)lParam1, (DWORD)lParam2);
+
+        case ICM_X264VFW_FLUSH_EVENTS:
+            return x264vfw_events_flush(codec);
+
         default:
             if (uMsg < DRV_USER)
                 return DefDriverProc(dwDriverId, hDriver, uMsg, lParam1, lParam2);
@@ -213,3 +419,22 @@ LRESULT WINAPI attribute_align_arg DriverProc(DWORD_PTR dwDriverId, HDRVR hDrive
                 return ICERR_UNSUPPORTED;
     }
 }
+
+/* This little puppy handles the calls which VFW programs send out to the codec */
+LRESULT WINAPI attribute_align_arg DriverProc(DWORD_PTR dwDriverId, HDRVR hDriver, UINT uMsg, LPARAM lParam1, LPARAM lParam2)
+{
+    CODEC *codec = (CODEC *)dwDriverId;
+    int64_t start;
+    LRESULT ret;
+
+    if (!x264vfw_is_recorded(uMsg) || !codec || (!codec->trace && !codec->stats_file))
+        return x264vfw_driver_proc(dwDriverId, hDriver, uMsg, lParam1, lParam2);
+
+    start = codec->trace ? x264vfw_trace_time(codec->trace) : 0;
+    ret = x264vfw_driver_proc(dwDriverId, hDriver, uMsg, lParam1, lParam2);
+    if (codec->trace)
+        x264vfw_decompress_record(codec, uMsg, lParam1, lParam2, ret, start, x264vfw_trace_time(codec->trace));
+    if (codec->stats_file)
+        x264vfw_stats_poll(codec);
+    return ret;
+}
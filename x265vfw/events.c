@@ -0,0 +1,135 @@
+/*****************************************************************************
+ * events.c: runtime event trace of the decoding pipeline
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "events.h"
+
+static const char * const event_names[X264VFW_EV_COUNT] =
+{
+    "frame", "copy", "nal rewrite", "decode", "convert", "band", "black", "error", "log", "resync"
+};
+
+int x264vfw_events_init(x264vfw_events_t **p_events, int size)
+{
+    x264vfw_events_t *events;
+    uint32_t ring_size = 1;
+
+    *p_events = NULL;
+    while (ring_size < (uint32_t)size && ring_size < (1u << 24))
+        ring_size <<= 1;
+
+    if (!(events = malloc(sizeof(x264vfw_events_t))))
+        return -1;
+    memset(events, 0, sizeof(x264vfw_events_t));
+    events->ring = calloc(ring_size, sizeof(x264vfw_event_t));
+    events->messages = calloc(X264VFW_EV_MESSAGES, X264VFW_EV_MESSAGE_SIZE);
+    if (!events->ring || !events->messages)
+    {
+        x264vfw_events_delete(events);
+        return -1;
+    }
+    events->mask = ring_size - 1;
+    events->ticks_start = x264vfw_ticks();
+    events->time_start = x264vfw_mdate();
+    *p_events = events;
+    return 0;
+}
+
+void x264vfw_events_delete(x264vfw_events_t *events)
+{
+    if (!events)
+        return;
+    free(events->ring);
+    free(events->messages);
+    free(events);
+}
+
+void x264vfw_event_message(x264vfw_events_t *events, const char *fmt, va_list vl)
+{
+    uint32_t slot = x264vfw_atomic_fetch_add(&events->next_message, 1) & (X264VFW_EV_MESSAGES - 1);
+
+    vsnprintf(events->messages[slot], X264VFW_EV_MESSAGE_SIZE, fmt, vl);
+    x264vfw_event_put(events, X264VFW_EV_LOG, X264VFW_EV_INSTANT, slot);
+}
+
+/* JSON string of a log message, without the line breaks libav ends them with */
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s >= 0x20)
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void write_ring(FILE *f, x264vfw_events_t *events, int pid, int *first)
+{
+    uint32_t next = events->next;
+    uint32_t count = X264VFW_MIN(next, events->mask + 1);
+    int64_t ticks = x264vfw_ticks() - events->ticks_start;
+    int64_t time = x264vfw_mdate() - events->time_start;
+    /* Microseconds per tick, the TSC rate isn't known otherwise */
+    double scale = ticks > 0 && time > 0 ? (double)time / ticks : 1.0;
+    uint32_t i;
+
+    for (i = next - count; i != next; i++)
+    {
+        const x264vfw_event_t *ev = &events->ring[i & events->mask];
+
+        if (ev->type >= X264VFW_EV_COUNT || !ev->phase)
+            continue;
+        fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+                *first ? "" : ",\n", event_names[ev->type], ev->phase,
+                events->time_start + (ev->time - events->ticks_start) * scale, pid, ev->thread);
+        if (ev->phase == X264VFW_EV_INSTANT)
+            fputs(",\"s\":\"t\"", f);
+        if (ev->type == X264VFW_EV_LOG)
+        {
+            fputs(",\"args\":{\"message\":", f);
+            write_json_string(f, events->messages[ev->arg & (X264VFW_EV_MESSAGES - 1)]);
+            fputc('}', f);
+        }
+        else if (ev->type == X264VFW_EV_BAND || ev->type == X264VFW_EV_ERROR || ev->type == X264VFW_EV_RESYNC)
+            fprintf(f, ",\"args\":{\"%s\":%d}", ev->type == X264VFW_EV_BAND ? "band" : ev->type == X264VFW_EV_ERROR ? "line" : "waiting", ev->arg);
+        fputc('}', f);
+        *first = 0;
+    }
+}
+
+int x264vfw_events_write_json(const char *filename, x264vfw_events_t *events, x264vfw_events_t *log, int pid)
+{
+    int first = 1;
+    FILE *f;
+
+    if (!(f = fopen(filename, "w")))
+    {
+        DPRINTF("can't create %s\n", filename);
+        return -1;
+    }
+    fputs("{\"traceEvents\":[\n", f);
+    write_ring(f, events, pid, &first);
+    if (log)
+        write_ring(f, log, pid, &first);
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+    return fclose(f) ? -1 : 0;
+}
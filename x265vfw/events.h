@@ -0,0 +1,98 @@
+/*****************************************************************************
+ * events.h: runtime event trace of the decoding pipeline
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_EVENTS_H
+#define X264VFW_EVENTS_H
+
+#include "common.h"
+
+/* Event types */
+#define X264VFW_EV_FRAME      0 /* x264vfw_decoder_decode */
+#define X264VFW_EV_COPY       1 /* packet preparation, cache lookups */
+#define X264VFW_EV_NAL        2 /* rewrite of size prefixed NAL units to Annex B */
+#define X264VFW_EV_DECODE     3 /* avcodec_decode_video2 */
+#define X264VFW_EV_CONVERT    4 /* the whole colorspace conversion */
+#define X264VFW_EV_BAND       5 /* one band of the conversion, arg: band */
+#define X264VFW_EV_BLACK      6 /* black frame shown */
+#define X264VFW_EV_ERROR      7 /* arg: source line */
+#define X264VFW_EV_LOG        8 /* libav log message, arg: message slot */
+#define X264VFW_EV_RESYNC     9 /* resilient mode: the reference chain broke, arg: 1 - waiting, 0 - resumed */
+#define X264VFW_EV_COUNT      10
+
+/* Phases, as in the Chrome trace format */
+#define X264VFW_EV_BEGIN      'B'
+#define X264VFW_EV_END        'E'
+#define X264VFW_EV_INSTANT    'i'
+
+#define X264VFW_EV_MESSAGES     256 /* slots of the log messages, a power of two */
+#define X264VFW_EV_MESSAGE_SIZE 128
+
+typedef struct
+{
+    int64_t  time;   /* x264vfw_ticks */
+    uint32_t thread;
+    int32_t  arg;
+    uint8_t  type;
+    uint8_t  phase;
+    uint8_t  reserved[6];
+} x264vfw_event_t;
+
+typedef struct
+{
+    x264vfw_event_t   *ring;
+    uint32_t          mask;       /* ring size - 1 */
+    volatile uint32_t next;       /* events ever put, the writers only add to it */
+    char              (*messages)[X264VFW_EV_MESSAGE_SIZE];
+    volatile uint32_t next_message;
+    int64_t           ticks_start; /* x264vfw_ticks and x264vfw_mdate at the creation, for the rate of the ticks */
+    int64_t           time_start;
+} x264vfw_events_t;
+
+/* Ring of the last size events (rounded up to a power of two). Returns 0 on success */
+int  x264vfw_events_init(x264vfw_events_t **p_events, int size);
+void x264vfw_events_delete(x264vfw_events_t *events);
+
+/* Lock-free, any thread may put events */
+static inline void x264vfw_event_put(x264vfw_events_t *events, int type, int phase, int32_t arg)
+{
+    x264vfw_event_t *ev = &events->ring[x264vfw_atomic_fetch_add(&events->next, 1) & events->mask];
+
+    ev->time = x264vfw_ticks();
+    ev->thread = x264vfw_thread_id();
+    ev->arg = arg;
+    ev->type = type;
+    ev->phase = phase;
+}
+
+void x264vfw_event_message(x264vfw_events_t *events, const char *fmt, va_list vl);
+
+/* Write the events of the ring, then those of log (may be NULL), as a Chrome trace.
+ * Events which are put meanwhile may come out torn. Returns 0 on success */
+int  x264vfw_events_write_json(const char *filename, x264vfw_events_t *events, x264vfw_events_t *log, int pid);
+
+/* Costs a test of the pointer when the trace is off, nothing if it isn't compiled in */
+#if X264VFW_EVENTS
+#define X264VFW_EVENT(events, type, phase, arg) \
+    do { if (events) x264vfw_event_put(events, type, phase, arg); } while (0)
+#else
+#define X264VFW_EVENT(events, type, phase, arg) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,253 @@
+/*****************************************************************************
+ * framepool.c: pooled frame buffers for the decoder
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "framepool.h"
+
+#include <limits.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#define FRAMEPOOL_ALIGN(x) (((x) + X264VFW_FRAMEPOOL_ALIGN - 1) & ~(X264VFW_FRAMEPOOL_ALIGN - 1))
+
+typedef struct
+{
+    int pix_fmt;
+    int width;
+    int height;
+    int linesize[4];
+    int offset[4];
+    int size;
+} x264vfw_frame_layout_t;
+
+typedef struct x264vfw_frame_slot_t
+{
+    uint8_t *mem;
+    uint8_t *data;  /* mem aligned to X264VFW_FRAMEPOOL_ALIGN */
+    struct x264vfw_framepool_t  *pool;
+    struct x264vfw_frame_slot_t *next;
+} x264vfw_frame_slot_t;
+
+struct x264vfw_framepool_t
+{
+    x264vfw_mutex_t        mutex;  /* the frame threads allocate and release concurrently */
+    x264vfw_frame_layout_t layout;
+    x264vfw_frame_slot_t   *slots;
+    x264vfw_frame_slot_t   *free;
+    int                    max_frames;
+    int                    frames;
+    int                    in_use;
+    int                    high_water;
+    uint32_t               fallbacks;
+    int                    closed;
+};
+
+static int framepool_layout(AVCodecContext *ctx, AVFrame *frame, x264vfw_frame_layout_t *layout)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    int width = frame->width;
+    int height = frame->height;
+    int64_t size = 0;
+    int i, planes;
+
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)))
+        return -1;
+
+    memset(layout, 0, sizeof(x264vfw_frame_layout_t));
+    layout->pix_fmt = frame->format;
+    layout->width = frame->width;
+    layout->height = frame->height;
+
+    /* Padding which the motion compensation and the SIMD code of libavcodec expect */
+    avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+    if (av_image_fill_linesizes(layout->linesize, frame->format, width) < 0)
+        return -1;
+
+    planes = av_pix_fmt_count_planes(frame->format);
+    if (planes <= 0 || planes > 4)
+        return -1;
+    for (i = 0; i < planes; i++)
+    {
+        int plane_height = (i == 1 || i == 2) ? -((-height) >> desc->log2_chroma_h) : height;
+        if (linesize_align[i] > X264VFW_FRAMEPOOL_ALIGN)
+            return -1;
+        layout->linesize[i] = FRAMEPOOL_ALIGN(layout->linesize[i]);
+        layout->offset[i] = size;
+        /* libavcodec may read a few bytes past the last line */
+        size += FRAMEPOOL_ALIGN((int64_t)layout->linesize[i] * plane_height + 16);
+        if (size > INT_MAX - X264VFW_FRAMEPOOL_ALIGN)
+            return -1;
+    }
+    layout->size = size;
+    return 0;
+}
+
+/* Must be called with the mutex held and no buffers in use */
+static void framepool_free_slots(x264vfw_framepool_t *pool)
+{
+    int i;
+    for (i = 0; i < pool->frames; i++)
+        av_freep(&pool->slots[i].mem);
+    pool->frames = 0;
+    pool->free = NULL;
+}
+
+static void framepool_destroy(x264vfw_framepool_t *pool)
+{
+    framepool_free_slots(pool);
+    x264vfw_mutex_destroy(&pool->mutex);
+    av_free(pool->slots);
+    av_free(pool);
+}
+
+static void framepool_release(void *opaque, uint8_t *data)
+{
+    x264vfw_frame_slot_t *slot = opaque;
+    x264vfw_framepool_t *pool = slot->pool;
+    int destroy;
+
+    x264vfw_mutex_lock(&pool->mutex);
+    slot->next = pool->free;
+    pool->free = slot;
+    pool->in_use--;
+    destroy = pool->closed && !pool->in_use;
+    x264vfw_mutex_unlock(&pool->mutex);
+
+    if (destroy)
+        framepool_destroy(pool);
+}
+
+/* Must be called with the mutex held */
+static x264vfw_frame_slot_t *framepool_take(x264vfw_framepool_t *pool, const x264vfw_frame_layout_t *layout)
+{
+    x264vfw_frame_slot_t *slot;
+
+    if (memcmp(layout, &pool->layout, sizeof(x264vfw_frame_layout_t)))
+    {
+        /* The stream changed its format, the old buffers can go once the decoder gave them all back */
+        if (pool->in_use)
+            return NULL;
+        framepool_free_slots(pool);
+        pool->layout = *layout;
+    }
+
+    if ((slot = pool->free))
+        pool->free = slot->next;
+    else if (pool->frames < pool->max_frames)
+    {
+        /* Grows only until the DPB is full, then every frame reuses a buffer */
+        slot = &pool->slots[pool->frames];
+        if (!(slot->mem = av_malloc(layout->size + X264VFW_FRAMEPOOL_ALIGN - 1)))
+            return NULL;
+        slot->data = (uint8_t *)FRAMEPOOL_ALIGN((intptr_t)slot->mem);
+        slot->pool = pool;
+        pool->frames++;
+    }
+    else
+        return NULL;
+
+    pool->in_use++;
+    pool->high_water = X264VFW_MAX(pool->high_water, pool->in_use);
+    return slot;
+}
+
+static int framepool_get_buffer(AVCodecContext *ctx, AVFrame *frame, int flags)
+{
+    x264vfw_framepool_t *pool = ctx->opaque;
+    x264vfw_frame_layout_t layout;
+    x264vfw_frame_slot_t *slot = NULL;
+    int i, ok;
+
+    ok = framepool_layout(ctx, frame, &layout) == 0;
+    x264vfw_mutex_lock(&pool->mutex);
+    if (ok)
+        slot = framepool_take(pool, &layout);
+    if (!slot)
+        pool->fallbacks++;
+    x264vfw_mutex_unlock(&pool->mutex);
+
+    if (!slot)
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+
+    frame->buf[0] = av_buffer_create(slot->data, layout.size, framepool_release, slot, 0);
+    if (!frame->buf[0])
+    {
+        framepool_release(slot, NULL);
+        return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        frame->data[i] = layout.linesize[i] ? slot->data + layout.offset[i] : NULL;
+        frame->linesize[i] = layout.linesize[i];
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+int x264vfw_framepool_init(x264vfw_framepool_t **p_pool, int max_frames)
+{
+    x264vfw_framepool_t *pool;
+
+    *p_pool = NULL;
+    if (max_frames <= 0 || !(pool = av_mallocz(sizeof(x264vfw_framepool_t))))
+        return -1;
+    if (!(pool->slots = av_mallocz(max_frames * sizeof(x264vfw_frame_slot_t))))
+    {
+        av_free(pool);
+        return -1;
+    }
+    x264vfw_mutex_init(&pool->mutex);
+    pool->max_frames = max_frames;
+    *p_pool = pool;
+    return 0;
+}
+
+void x264vfw_framepool_attach(x264vfw_framepool_t *pool, AVCodecContext *ctx)
+{
+    ctx->opaque = pool;
+    ctx->get_buffer2 = framepool_get_buffer;
+    ctx->thread_safe_callbacks = 1;
+}
+
+void x264vfw_framepool_get_stats(x264vfw_framepool_t *pool, x264vfw_framepool_stats_t *stats)
+{
+    x264vfw_mutex_lock(&pool->mutex);
+    stats->frames = pool->frames;
+    stats->frames_max = pool->max_frames;
+    stats->high_water = pool->high_water;
+    stats->frame_size = pool->layout.size;
+    stats->fallbacks = pool->fallbacks;
+    x264vfw_mutex_unlock(&pool->mutex);
+}
+
+void x264vfw_framepool_delete(x264vfw_framepool_t *pool)
+{
+    int destroy;
+
+    if (!pool)
+        return;
+    x264vfw_mutex_lock(&pool->mutex);
+    pool->closed = 1;
+    destroy = !pool->in_use;
+    x264vfw_mutex_unlock(&pool->mutex);
+
+    if (destroy)
+        framepool_destroy(pool);
+}
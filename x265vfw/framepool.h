@@ -0,0 +1,51 @@
+/*****************************************************************************
+ * framepool.h: pooled frame buffers for the decoder
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_FRAMEPOOL_H
+#define X264VFW_FRAMEPOOL_H
+
+#include "common.h"
+
+#include <libavcodec/avcodec.h>
+
+/* Alignment of the planes and the line sizes, enough for the AVX2 paths */
+#define X264VFW_FRAMEPOOL_ALIGN 64
+
+typedef struct
+{
+    int      frames;      /* frame buffers allocated */
+    int      frames_max;
+    int      high_water;  /* most frame buffers in use at once */
+    int      frame_size;
+    uint32_t fallbacks;   /* frames given to the default allocator */
+} x264vfw_framepool_stats_t;
+
+typedef struct x264vfw_framepool_t x264vfw_framepool_t;
+
+/* Pool of at most max_frames frame buffers which are reused without going back to the heap.
+ * Returns 0 on success */
+int  x264vfw_framepool_init(x264vfw_framepool_t **p_pool, int max_frames);
+/* Make the decoder allocate its frames from the pool, must be called before avcodec_open2 */
+void x264vfw_framepool_attach(x264vfw_framepool_t *pool, AVCodecContext *ctx);
+void x264vfw_framepool_get_stats(x264vfw_framepool_t *pool, x264vfw_framepool_stats_t *stats);
+/* The buffers which the decoder still holds are freed when they are released */
+void x264vfw_framepool_delete(x264vfw_framepool_t *pool);
+
+#endif
@@ -0,0 +1,415 @@
+/*****************************************************************************
+ * hevc.c: hevc bitstream parsing functions
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "hevc.h"
+
+/* Bit reader which drops emulation prevention bytes on the fly */
+typedef struct
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    int           zeros;
+    int           cur;
+    int           bits;
+    int           overrun;
+} bs_t;
+
+static void bs_init(bs_t *s, const uint8_t *buf, int size)
+{
+    s->p = buf;
+    s->end = buf + size;
+    s->zeros = 0;
+    s->cur = 0;
+    s->bits = 0;
+    s->overrun = 0;
+}
+
+static int bs_read1(bs_t *s)
+{
+    if (!s->bits)
+    {
+        int b;
+        if (s->p >= s->end)
+        {
+            s->overrun = 1;
+            return 0;
+        }
+        b = *s->p++;
+        if (s->zeros >= 2 && b == 0x03)
+        {
+            s->zeros = 0;
+            if (s->p >= s->end)
+            {
+                s->overrun = 1;
+                return 0;
+            }
+            b = *s->p++;
+        }
+        s->zeros = b ? 0 : s->zeros + 1;
+        s->cur = b;
+        s->bits = 8;
+    }
+    s->bits--;
+    return (s->cur >> s->bits) & 1;
+}
+
+static uint32_t bs_read(bs_t *s, int n)
+{
+    uint32_t v = 0;
+    while (n--)
+        v = (v << 1) | bs_read1(s);
+    return v;
+}
+
+static void bs_skip(bs_t *s, int n)
+{
+    while (n--)
+        bs_read1(s);
+}
+
+static uint32_t bs_read_ue(bs_t *s)
+{
+    int i = 0;
+    while (!bs_read1(s))
+    {
+        if (++i > 31 || s->overrun)
+        {
+            s->overrun = 1;
+            return 0;
+        }
+    }
+    return ((1u << i) - 1) + bs_read(s, i);
+}
+
+static int32_t bs_read_se(bs_t *s)
+{
+    uint32_t v = bs_read_ue(s);
+    return (v & 1) ? (int32_t)((v + 1) >> 1) : -(int32_t)(v >> 1);
+}
+
+static void skip_profile_tier_level(bs_t *s, int max_sub_layers_minus1)
+{
+    int sub_layer_profile_present[8];
+    int sub_layer_level_present[8];
+    int i;
+
+    /* general_profile_space .. general_level_idc */
+    bs_skip(s, 96);
+    for (i = 0; i < max_sub_layers_minus1; i++)
+    {
+        sub_layer_profile_present[i] = bs_read1(s);
+        sub_layer_level_present[i] = bs_read1(s);
+    }
+    if (max_sub_layers_minus1 > 0)
+        for (i = max_sub_layers_minus1; i < 8; i++)
+            bs_skip(s, 2);
+    for (i = 0; i < max_sub_layers_minus1; i++)
+    {
+        if (sub_layer_profile_present[i])
+            bs_skip(s, 88);
+        if (sub_layer_level_present[i])
+            bs_skip(s, 8);
+    }
+}
+
+int x264vfw_hevc_parse_sps(x264vfw_hevc_sps_t *sps, const uint8_t *nal, int nal_size)
+{
+    bs_t s;
+    int max_sub_layers_minus1;
+    int sub_layer_ordering_info_present;
+    int sub_width = 1, sub_height = 1;
+    int i;
+
+    if (nal_size < 3 || HEVC_NAL_TYPE(nal) != HEVC_NAL_SPS)
+        return -1;
+
+    memset(sps, 0, sizeof(x264vfw_hevc_sps_t));
+    bs_init(&s, nal + 2, nal_size - 2);
+
+    bs_skip(&s, 4); /* sps_video_parameter_set_id */
+    max_sub_layers_minus1 = bs_read(&s, 3);
+    bs_skip(&s, 1); /* sps_temporal_id_nesting_flag */
+    if (max_sub_layers_minus1 > 6)
+        return -1;
+    skip_profile_tier_level(&s, max_sub_layers_minus1);
+
+    bs_read_ue(&s); /* sps_seq_parameter_set_id */
+    sps->chroma_format_idc = bs_read_ue(&s);
+    if (sps->chroma_format_idc > 3)
+        return -1;
+    if (sps->chroma_format_idc == 3)
+        bs_skip(&s, 1); /* separate_colour_plane_flag */
+    if (sps->chroma_format_idc == 1 || sps->chroma_format_idc == 2)
+        sub_width = 2;
+    if (sps->chroma_format_idc == 1)
+        sub_height = 2;
+
+    sps->width = bs_read_ue(&s);
+    sps->height = bs_read_ue(&s);
+    if (bs_read1(&s)) /* conformance_window_flag */
+    {
+        int left   = bs_read_ue(&s);
+        int right  = bs_read_ue(&s);
+        int top    = bs_read_ue(&s);
+        int bottom = bs_read_ue(&s);
+        sps->width -= (left + right) * sub_width;
+        sps->height -= (top + bottom) * sub_height;
+    }
+
+    sps->bit_depth_luma = bs_read_ue(&s) + 8;
+    sps->bit_depth_chroma = bs_read_ue(&s) + 8;
+    bs_read_ue(&s); /* log2_max_pic_order_cnt_lsb_minus4 */
+
+    /* Keep the values of the highest sub-layer */
+    sub_layer_ordering_info_present = bs_read1(&s);
+    for (i = sub_layer_ordering_info_present ? 0 : max_sub_layers_minus1; i <= max_sub_layers_minus1; i++)
+    {
+        sps->max_dec_pic_buffering = bs_read_ue(&s) + 1;
+        sps->max_num_reorder_pics = bs_read_ue(&s);
+        bs_read_ue(&s); /* sps_max_latency_increase_plus1 */
+    }
+
+    if (s.overrun || sps->width <= 0 || sps->height <= 0 ||
+        sps->bit_depth_luma > 16 || sps->bit_depth_chroma > 16)
+        return -1;
+    return 0;
+}
+
+int x264vfw_hevc_parse_pps(x264vfw_hevc_pps_t *pps, const uint8_t *nal, int nal_size)
+{
+    bs_t s;
+
+    if (nal_size < 2 || HEVC_NAL_TYPE(nal) != HEVC_NAL_PPS)
+        return -1;
+    bs_init(&s, nal + 2, nal_size - 2);
+
+    bs_read_ue(&s);            /* pps_pic_parameter_set_id */
+    bs_read_ue(&s);            /* pps_seq_parameter_set_id */
+    bs_skip(&s, 1 + 1 + 3 + 1 + 1); /* dependent_slice_segments_enabled_flag .. cabac_init_present_flag */
+    bs_read_ue(&s);            /* num_ref_idx_l0_default_active_minus1 */
+    bs_read_ue(&s);            /* num_ref_idx_l1_default_active_minus1 */
+    bs_read_se(&s);            /* init_qp_minus26 */
+    bs_skip(&s, 2);            /* constrained_intra_pred_flag, transform_skip_enabled_flag */
+    if (bs_read1(&s))          /* cu_qp_delta_enabled_flag */
+        bs_read_ue(&s);        /* diff_cu_qp_delta_depth */
+    bs_read_se(&s);            /* pps_cb_qp_offset */
+    bs_read_se(&s);            /* pps_cr_qp_offset */
+    bs_skip(&s, 4);            /* pps_slice_chroma_qp_offsets_present_flag .. transquant_bypass_enabled_flag */
+    pps->tiles_enabled = bs_read1(&s);
+    pps->entropy_coding_sync_enabled = bs_read1(&s);
+    pps->num_tile_columns = 1;
+    pps->num_tile_rows = 1;
+    if (pps->tiles_enabled)
+    {
+        pps->num_tile_columns = bs_read_ue(&s) + 1;
+        pps->num_tile_rows = bs_read_ue(&s) + 1;
+    }
+
+    if (s.overrun)
+        return -1;
+    return 0;
+}
+
+int x264vfw_hevc_is_hvcc(const uint8_t *buf, int buf_size)
+{
+    /* configurationVersion must be 1, check also the reserved bits */
+    return buf_size >= 23 && buf[0] == 0x01 &&
+           (buf[13] & 0xf0) == 0xf0 && (buf[15] & 0xfc) == 0xfc &&
+           (buf[16] & 0xfc) == 0xfc && (buf[17] & 0xf8) == 0xf8 &&
+           (buf[18] & 0xf8) == 0xf8;
+}
+
+int x264vfw_hevc_hvcc_nal_length_size(const uint8_t *buf)
+{
+    /* lengthSizeMinusOne == 2 is not allowed */
+    int length_size = (buf[21] & 0x03) + 1;
+    return length_size == 3 ? -1 : length_size;
+}
+
+int x264vfw_hevc_hvcc_to_annexb(uint8_t *out, const uint8_t *buf, int buf_size)
+{
+    const uint8_t *p = buf + 23;
+    const uint8_t *end = buf + buf_size;
+    int num_arrays = buf[22];
+    int out_size = 0;
+    int i, j;
+
+    for (i = 0; i < num_arrays; i++)
+    {
+        int num_nalus;
+        if (end - p < 3)
+            return -1;
+        num_nalus = (p[1] << 8) | p[2];
+        p += 3;
+        for (j = 0; j < num_nalus; j++)
+        {
+            int nal_size;
+            if (end - p < 2)
+                return -1;
+            nal_size = (p[0] << 8) | p[1];
+            p += 2;
+            if (end - p < nal_size)
+                return -1;
+            if (out)
+            {
+                out[out_size + 0] = 0x00;
+                out[out_size + 1] = 0x00;
+                out[out_size + 2] = 0x00;
+                out[out_size + 3] = 0x01;
+                memcpy(out + out_size + 4, p, nal_size);
+            }
+            out_size += nal_size + 4;
+            p += nal_size;
+        }
+    }
+    return out_size;
+}
+
+/* Return the start of the next NAL unit after a 00 00 01 startcode or NULL */
+static const uint8_t *find_nal_annexb(const uint8_t *p, const uint8_t *end)
+{
+    for (; p + 3 <= end; p++)
+        if (p[0] == 0x00 && p[1] == 0x00 && p[2] == 0x01)
+            return p + 3;
+    return NULL;
+}
+
+/* Find the first NAL unit of the given type in an Annex B buffer */
+static const uint8_t *find_nal_type_annexb(const uint8_t *buf, int buf_size, int type, int *nal_size)
+{
+    const uint8_t *end = buf + buf_size;
+    const uint8_t *nal = find_nal_annexb(buf, end);
+
+    while (nal)
+    {
+        const uint8_t *next = find_nal_annexb(nal, end);
+        const uint8_t *nal_end = next ? next - 3 : end;
+        if (nal_end - nal >= 2 && HEVC_NAL_TYPE(nal) == type)
+        {
+            *nal_size = nal_end - nal;
+            return nal;
+        }
+        nal = next;
+    }
+    return NULL;
+}
+
+/* Find the first NAL unit of the given type in hvcC or Annex B extradata */
+static const uint8_t *find_nal_type_extradata(const uint8_t *buf, int buf_size, int type, int *nal_size)
+{
+    const uint8_t *p, *end;
+    int num_arrays, i, j;
+
+    if (!x264vfw_hevc_is_hvcc(buf, buf_size))
+        return find_nal_type_annexb(buf, buf_size, type, nal_size);
+
+    p = buf + 23;
+    end = buf + buf_size;
+    num_arrays = buf[22];
+    for (i = 0; i < num_arrays; i++)
+    {
+        int nal_type, num_nalus;
+        if (end - p < 3)
+            return NULL;
+        nal_type = p[0] & 0x3f;
+        num_nalus = (p[1] << 8) | p[2];
+        p += 3;
+        for (j = 0; j < num_nalus; j++)
+        {
+            int size;
+            if (end - p < 2)
+                return NULL;
+            size = (p[0] << 8) | p[1];
+            p += 2;
+            if (end - p < size)
+                return NULL;
+            if (nal_type == type && size >= 2)
+            {
+                *nal_size = size;
+                return p;
+            }
+            p += size;
+        }
+    }
+    return NULL;
+}
+
+int x264vfw_hevc_first_vcl_type(const uint8_t *buf, int buf_size, int nal_length_size)
+{
+    const uint8_t *end = buf + buf_size;
+    const uint8_t *nal;
+
+    if (!nal_length_size)
+    {
+        for (nal = find_nal_annexb(buf, end); nal; nal = find_nal_annexb(nal, end))
+            if (nal < end && HEVC_NAL_TYPE(nal) < HEVC_NAL_VPS)
+                return HEVC_NAL_TYPE(nal);
+        return -1;
+    }
+
+    nal = buf;
+    while (end - nal >= nal_length_size)
+    {
+        uint32_t nal_size = 0;
+        int i;
+        for (i = 0; i < nal_length_size; i++)
+            nal_size = (nal_size << 8) | *nal++;
+        if (nal_size < 1 || nal_size > (uint32_t)(end - nal))
+            return -1;
+        if (HEVC_NAL_TYPE(nal) < HEVC_NAL_VPS)
+            return HEVC_NAL_TYPE(nal);
+        nal += nal_size;
+    }
+    return -1;
+}
+
+int x264vfw_hevc_is_irap(const uint8_t *buf, int buf_size, int nal_length_size)
+{
+    int type = x264vfw_hevc_first_vcl_type(buf, buf_size, nal_length_size);
+    return type >= HEVC_NAL_IRAP_FIRST && type <= HEVC_NAL_IRAP_LAST;
+}
+
+int x264vfw_hevc_find_sps_annexb(x264vfw_hevc_sps_t *sps, const uint8_t *buf, int buf_size)
+{
+    int nal_size;
+    const uint8_t *nal = find_nal_type_annexb(buf, buf_size, HEVC_NAL_SPS, &nal_size);
+    return nal ? x264vfw_hevc_parse_sps(sps, nal, nal_size) : -1;
+}
+
+int x264vfw_hevc_find_pps_annexb(x264vfw_hevc_pps_t *pps, const uint8_t *buf, int buf_size)
+{
+    int nal_size;
+    const uint8_t *nal = find_nal_type_annexb(buf, buf_size, HEVC_NAL_PPS, &nal_size);
+    return nal ? x264vfw_hevc_parse_pps(pps, nal, nal_size) : -1;
+}
+
+int x264vfw_hevc_parse_extradata(x264vfw_hevc_sps_t *sps, const uint8_t *buf, int buf_size)
+{
+    int nal_size;
+    const uint8_t *nal = find_nal_type_extradata(buf, buf_size, HEVC_NAL_SPS, &nal_size);
+    return nal ? x264vfw_hevc_parse_sps(sps, nal, nal_size) : -1;
+}
+
+int x264vfw_hevc_parse_extradata_pps(x264vfw_hevc_pps_t *pps, const uint8_t *buf, int buf_size)
+{
+    int nal_size;
+    const uint8_t *nal = find_nal_type_extradata(buf, buf_size, HEVC_NAL_PPS, &nal_size);
+    return nal ? x264vfw_hevc_parse_pps(pps, nal, nal_size) : -1;
+}
@@ -0,0 +1,93 @@
+/*****************************************************************************
+ * hevc.h: hevc bitstream parsing functions
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_HEVC_H
+#define X264VFW_HEVC_H
+
+#include "common.h"
+
+/* NAL unit types */
+#define HEVC_NAL_RASL_N     8
+#define HEVC_NAL_RASL_R     9
+#define HEVC_NAL_IRAP_FIRST 16
+#define HEVC_NAL_CRA        21
+#define HEVC_NAL_IRAP_LAST  23
+#define HEVC_NAL_VPS        32
+#define HEVC_NAL_SPS        33
+#define HEVC_NAL_PPS        34
+
+#define HEVC_NAL_TYPE(p) (((p)[0] >> 1) & 0x3f)
+
+/* The subset of the SPS which the driver cares about */
+typedef struct
+{
+    int chroma_format_idc;     /* 0 - monochrome, 1 - 4:2:0, 2 - 4:2:2, 3 - 4:4:4 */
+    int bit_depth_luma;
+    int bit_depth_chroma;
+    int width;                 /* after the conformance window */
+    int height;
+    int max_dec_pic_buffering;
+    int max_num_reorder_pics;
+} x264vfw_hevc_sps_t;
+
+/* The subset of the PPS which decides how the decoder can be threaded */
+typedef struct
+{
+    int tiles_enabled;
+    int entropy_coding_sync_enabled; /* WPP */
+    int num_tile_columns;
+    int num_tile_rows;
+} x264vfw_hevc_pps_t;
+
+/* Parse one SPS NAL unit (starting with the NAL header). Returns 0 on success */
+int x264vfw_hevc_parse_sps(x264vfw_hevc_sps_t *sps, const uint8_t *nal, int nal_size);
+
+/* Parse one PPS NAL unit (starting with the NAL header). Returns 0 on success */
+int x264vfw_hevc_parse_pps(x264vfw_hevc_pps_t *pps, const uint8_t *nal, int nal_size);
+
+/* Check whether the buffer looks like an HEVCDecoderConfigurationRecord */
+int x264vfw_hevc_is_hvcc(const uint8_t *buf, int buf_size);
+
+/* Size of the NAL unit length fields (1, 2 or 4) of an hvcC record or -1 */
+int x264vfw_hevc_hvcc_nal_length_size(const uint8_t *buf);
+
+/* Convert the parameter set arrays of an hvcC record to Annex B. Returns the size of the result
+ * (out may be NULL to only compute it) or -1 if the record is broken */
+int x264vfw_hevc_hvcc_to_annexb(uint8_t *out, const uint8_t *buf, int buf_size);
+
+/* NAL unit type of the first VCL NAL unit of the access unit or -1. nal_length_size is 0 for Annex B */
+int x264vfw_hevc_first_vcl_type(const uint8_t *buf, int buf_size, int nal_length_size);
+
+/* Check whether the access unit is an IRAP picture */
+int x264vfw_hevc_is_irap(const uint8_t *buf, int buf_size, int nal_length_size);
+
+/* Find and parse the first SPS in an Annex B buffer. Returns 0 on success */
+int x264vfw_hevc_find_sps_annexb(x264vfw_hevc_sps_t *sps, const uint8_t *buf, int buf_size);
+
+/* Find and parse the first PPS in an Annex B buffer. Returns 0 on success */
+int x264vfw_hevc_find_pps_annexb(x264vfw_hevc_pps_t *pps, const uint8_t *buf, int buf_size);
+
+/* Find and parse the first SPS in hvcC or Annex B extradata. Returns 0 on success */
+int x264vfw_hevc_parse_extradata(x264vfw_hevc_sps_t *sps, const uint8_t *buf, int buf_size);
+
+/* Find and parse the first PPS in hvcC or Annex B extradata. Returns 0 on success */
+int x264vfw_hevc_parse_extradata_pps(x264vfw_hevc_pps_t *pps, const uint8_t *buf, int buf_size);
+
+#endif
@@ -0,0 +1,299 @@
+/*****************************************************************************
+ * replay.c: replay of recorded decompression sessions without VFW
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "decoder.h"
+
+/* Normally defined by driverproc.c */
+x264vfw_mutex_t x264vfw_CS;
+
+/* sizeof(BITMAPINFOHEADER), the headers are read field by field without VFW */
+#define BI_SIZE 40
+
+#define RECORD_TYPES (X264VFW_TRACE_KEYFRAME_ONLY + 1)
+
+static const char * const record_names[RECORD_TYPES] =
+{
+    "?", "GET_FORMAT", "QUERY", "BEGIN", "FRAME", "END", "KEYFRAME"
+};
+
+typedef struct
+{
+    int     calls;
+    int64_t recorded;       /* microseconds, by the host */
+    int64_t recorded_max;
+    int64_t replayed;       /* microseconds, here */
+    int64_t replayed_max;
+} replay_stats_t;
+
+typedef struct
+{
+    CODEC    codec;
+    int      open;
+    int      csp;
+    uint8_t  *format;       /* input and output headers of the open decoder */
+    uint32_t format_size;
+    uint8_t  *output;
+    int      output_size;
+} replay_t;
+
+static int32_t rl32(const uint8_t *p)
+{
+    return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static void replay_sleep_until(int64_t time)
+{
+    int64_t wait = time - x264vfw_mdate();
+
+    if (wait <= 0)
+        return;
+#ifdef _WIN32
+    Sleep((DWORD)(wait / 1000));
+#else
+    {
+        struct timespec ts;
+        ts.tv_sec = wait / 1000000;
+        ts.tv_nsec = wait % 1000000 * 1000;
+        nanosleep(&ts, NULL);
+    }
+#endif
+}
+
+static void replay_close(replay_t *r)
+{
+    if (r->open)
+        x264vfw_decoder_close(&r->codec);
+    r->open = 0;
+    free(r->format);
+    r->format = NULL;
+    r->format_size = 0;
+}
+
+/* Same decisions as x264vfw_decompress_begin: restart with an unchanged format and settings, open otherwise */
+static void replay_begin(replay_t *r, const x264vfw_trace_record_t *record, const uint8_t *data)
+{
+    x264vfw_trace_begin_t begin;
+    x264vfw_settings_t settings;
+    const uint8_t *inhdr;
+    uint32_t format_size;
+
+    if (record->size < sizeof(begin))
+        return;
+    memcpy(&begin, data, sizeof(begin));
+    if (begin.in_size < BI_SIZE || begin.out_size < BI_SIZE ||
+        (uint64_t)sizeof(begin) + begin.settings_size + begin.in_size + begin.out_size > record->size)
+        return;
+
+    /* Version 1 traces keep the settings of the command line */
+    settings = r->codec.settings;
+    if (begin.settings_size &&
+        x264vfw_settings_from_blob(&settings, data + sizeof(begin), (int)X264VFW_MIN(begin.settings_size, 1 << 30)) < 0)
+        fprintf(stderr, "unknown settings at %.3f s\n", record->time / 1000000.0);
+    x264vfw_decoder_set_settings(&r->codec, &settings);
+
+    /* The driver closed the decoder for a rejected BEGIN */
+    if (record->result != 0)
+    {
+        replay_close(r);
+        return;
+    }
+
+    inhdr = data + sizeof(begin) + begin.settings_size;
+    format_size = begin.in_size + begin.out_size;
+    if (r->open && r->format_size == format_size && !memcmp(r->format, inhdr, format_size) &&
+        x264vfw_decoder_restart(&r->codec) == 0)
+        return;
+
+    replay_close(r);
+    if (x264vfw_decoder_open(&r->codec, rl32(inhdr + 4), rl32(inhdr + 8), (uint32_t)rl32(inhdr + 16),
+                             begin.in_size > BI_SIZE ? inhdr + BI_SIZE : NULL, begin.in_size - BI_SIZE, begin.csp) < 0)
+    {
+        fprintf(stderr, "x264vfw_decoder_open failed at %.3f s\n", record->time / 1000000.0);
+        return;
+    }
+    r->open = 1;
+    r->csp = begin.csp;
+    if ((r->format = malloc(format_size)))
+    {
+        memcpy(r->format, inhdr, format_size);
+        r->format_size = format_size;
+    }
+}
+
+static void replay_frame(replay_t *r, const x264vfw_trace_record_t *record, uint8_t *data)
+{
+    x264vfw_trace_frame_t frame;
+    x264vfw_rect_t src, dst;
+    int picture_size;
+
+    if (!r->open || record->size < sizeof(frame))
+        return;
+    memcpy(&frame, data, sizeof(frame));
+    /* Rejected before decoding */
+    if (frame.dst[2] <= 0 || frame.dst[3] <= 0)
+        return;
+
+    picture_size = x264vfw_picture_get_size(x264vfw_csp_to_pix_fmt(r->csp), frame.width, frame.height);
+    if (picture_size <= 0)
+        return;
+    if (picture_size > r->output_size)
+    {
+        av_free(r->output);
+        r->output_size = 0;
+        if (!(r->output = av_malloc(picture_size)))
+            return;
+        r->output_size = picture_size;
+    }
+
+    src.x = frame.src[0];
+    src.y = frame.src[1];
+    src.width = frame.src[2];
+    src.height = frame.src[3];
+    dst.x = frame.dst[0];
+    dst.y = frame.dst[1];
+    dst.width = frame.dst[2];
+    dst.height = frame.dst[3];
+    x264vfw_decoder_decode(&r->codec, data + sizeof(frame), record->size - sizeof(frame), r->output,
+                           frame.width, frame.height, &src, &dst, frame.flags);
+}
+
+int main(int argc, char **argv)
+{
+    x264vfw_trace_t *trace;
+    x264vfw_trace_record_t record;
+    x264vfw_settings_t settings;
+    replay_stats_t stats[RECORD_TYPES];
+    replay_t r;
+    uint8_t *data;
+    const char *filename = NULL;
+    const char *events = NULL;
+    int realtime = 0;
+    int64_t stutter = 40000;
+    int stutters_recorded = 0;
+    int stutters_replayed = 0;
+    int64_t session = 0;
+    int64_t start;
+    int i, ret;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-r"))
+            realtime = 1;
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            stutter = atoi(argv[++i]) * 1000LL;
+        else if (!strcmp(argv[i], "-e") && i + 1 < argc)
+            events = argv[++i];
+        else
+            filename = argv[i];
+    }
+    if (!filename)
+    {
+        fprintf(stderr, "usage: %s [-r] [-s ms] [-e events.json] <trace>\n"
+                        "  -r       call at the recorded times, as the host did\n"
+                        "  -s ms    frames which took longer are stutters (default 40)\n"
+                        "  -e file  write the event trace of the replay (chrome://tracing)\n", argv[0]);
+        return 1;
+    }
+    if (x264vfw_trace_open(&trace, filename) < 0)
+    {
+        fprintf(stderr, "can't open the trace %s\n", filename);
+        return 1;
+    }
+
+    x264vfw_mutex_init(&x264vfw_CS);
+    avcodec_register_all();
+    x264vfw_decoder_load();
+
+    memset(stats, 0, sizeof(stats));
+    memset(&r, 0, sizeof(r));
+    /* Same settings as the driver would have without an INI file, until a BEGIN brings those it had */
+    x264vfw_settings_default(&settings);
+    x264vfw_settings_read_env(&settings);
+    x264vfw_decoder_set_settings(&r.codec, &settings);
+    if (X264VFW_EVENTS && events && x264vfw_events_init(&r.codec.events, X264VFW_EVENTS_SIZE) < 0)
+        fprintf(stderr, "can't allocate the event trace\n");
+
+    start = x264vfw_mdate();
+    while ((ret = x264vfw_trace_read(trace, &record, &data)) > 0)
+    {
+        int type = record.type < RECORD_TYPES ? record.type : 0;
+        int64_t call_start, duration;
+
+        if (realtime)
+            replay_sleep_until(start + record.time);
+
+        call_start = x264vfw_mdate();
+        switch (record.type)
+        {
+            case X264VFW_TRACE_BEGIN:
+                replay_begin(&r, &record, data);
+                break;
+            case X264VFW_TRACE_FRAME:
+                replay_frame(&r, &record, data);
+                break;
+            case X264VFW_TRACE_END:
+                if (r.open)
+                    x264vfw_decoder_end(&r.codec);
+                break;
+            case X264VFW_TRACE_KEYFRAME_ONLY:
+                if (record.size >= 4)
+                    x264vfw_decoder_set_keyframe_only(&r.codec, rl32(data));
+                break;
+            /* Only the format negotiation of VFW, nothing to replay */
+            default:
+                break;
+        }
+        duration = x264vfw_mdate() - call_start;
+
+        stats[type].calls++;
+        stats[type].recorded += record.duration;
+        stats[type].recorded_max = X264VFW_MAX(stats[type].recorded_max, record.duration);
+        stats[type].replayed += duration;
+        stats[type].replayed_max = X264VFW_MAX(stats[type].replayed_max, duration);
+        if (record.type == X264VFW_TRACE_FRAME)
+        {
+            stutters_recorded += record.duration > stutter;
+            stutters_replayed += duration > stutter;
+        }
+        session = record.time + record.duration;
+    }
+    if (ret < 0)
+        fprintf(stderr, "%s: read error, the replay stopped\n", filename);
+
+    printf("%-10s %8s %14s %12s %14s %12s\n", "call", "count", "recorded ms", "max ms", "replayed ms", "max ms");
+    for (i = 1; i < RECORD_TYPES; i++)
+        if (stats[i].calls)
+            printf("%-10s %8d %14.1f %12.2f %14.1f %12.2f\n", record_names[i], stats[i].calls,
+                   stats[i].recorded / 1000.0, stats[i].recorded_max / 1000.0,
+                   stats[i].replayed / 1000.0, stats[i].replayed_max / 1000.0);
+    printf("frames over %d ms: recorded %d, replayed %d\n", (int)(stutter / 1000), stutters_recorded, stutters_replayed);
+    printf("session: recorded %.1f ms, replayed %.1f ms\n", session / 1000.0, (x264vfw_mdate() - start) / 1000.0);
+
+    if (r.codec.events && x264vfw_events_write_json(events, r.codec.events, NULL, 0) < 0)
+        fprintf(stderr, "can't write %s\n", events);
+
+    replay_close(&r);
+    x264vfw_events_delete(r.codec.events);
+    av_free(r.output);
+    x264vfw_trace_close(trace);
+    x264vfw_decoder_unload();
+    x264vfw_mutex_destroy(&x264vfw_CS);
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*****************************************************************************
+ * settings.c: runtime settings of a decoder instance
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "settings.h"
+#include "csp.h"
+#include "thread.h"
+
+#include <stddef.h>
+
+static const char * const mode_names[] = { "latency", "throughput", NULL };
+static const char * const resilient_names[] = { "off", "untouched", "copy", NULL };
+static const char * const quality_names[] = { "fast", "normal", "high", NULL };
+/* Indexed by X264VFW_CSP_* */
+static const char * const output_names[] =
+{
+    "native", "I420", "YV12", "YV16", "YV24", "NV12", "YUY2", "UYVY", "BGR", "BGRA", "P010", "P016", "v210", "Y410", "Y416", NULL
+};
+
+typedef struct
+{
+    const char         *key;
+    size_t             offset;
+    const char * const *names;  /* the values by name, NULL - numbers only */
+    int                min;
+    int                max;
+} x264vfw_setting_t;
+
+#define SETTING(key, names, min, max) { #key, offsetof(x264vfw_settings_t, key), names, min, max }
+
+static const x264vfw_setting_t x264vfw_settings[] =
+{
+    SETTING(mode,            mode_names,    X264VFW_MODE_LATENCY, X264VFW_MODE_THROUGHPUT),
+    SETTING(threads,         NULL,          0, X264VFW_THREAD_MAX),
+    SETTING(convert_threads, NULL,          0, X264VFW_THREAD_MAX),
+    SETTING(quality,         quality_names, X264VFW_QUALITY_FAST, X264VFW_QUALITY_HIGH),
+    SETTING(output_csp,      output_names,  X264VFW_CSP_NONE, X264VFW_CSP_Y416),
+    SETTING(cache_size,      NULL,          0, 2048),
+    SETTING(frame_pool,      NULL,          0, 1),
+    SETTING(keyframe_only,   NULL,          0, 1),
+    SETTING(tonemap,         NULL,          0, 1),
+    SETTING(tonemap_peak,    NULL,          100, 10000),
+    SETTING(resilient,       resilient_names, X264VFW_RESILIENT_OFF, X264VFW_RESILIENT_COPY),
+    { NULL }
+};
+
+#define SETTING_FIELD(settings, setting) ((int32_t *)((uint8_t *)(settings) + (setting)->offset))
+
+void x264vfw_settings_default(x264vfw_settings_t *settings)
+{
+    memset(settings, 0, sizeof(x264vfw_settings_t));
+    settings->version         = X264VFW_SETTINGS_VERSION;
+    settings->size            = sizeof(x264vfw_settings_t);
+    settings->mode            = X264VFW_DECODER_MODE;
+    settings->threads         = 0;
+    settings->convert_threads = X264VFW_CONVERT_THREADS;
+    settings->quality         = X264VFW_CONVERT_QUALITY;
+    settings->output_csp      = X264VFW_OUTPUT_CSP;
+    settings->cache_size      = X264VFW_CACHE_SIZE;
+    settings->frame_pool      = X264VFW_FRAME_POOL;
+    settings->keyframe_only   = X264VFW_KEYFRAME_ONLY;
+    settings->tonemap         = X264VFW_TONEMAP;
+    settings->tonemap_peak    = X264VFW_TONEMAP_PEAK;
+    settings->resilient       = X264VFW_RESILIENT;
+}
+
+void x264vfw_settings_validate(x264vfw_settings_t *settings)
+{
+    const x264vfw_setting_t *setting;
+
+    settings->version = X264VFW_SETTINGS_VERSION;
+    settings->size = sizeof(x264vfw_settings_t);
+    for (setting = x264vfw_settings; setting->key; setting++)
+    {
+        int32_t *field = SETTING_FIELD(settings, setting);
+        *field = X264VFW_MIN(X264VFW_MAX(*field, setting->min), setting->max);
+    }
+}
+
+static int x264vfw_name_equal(const char *a, const char *b)
+{
+    for (; *a && *b; a++, b++)
+        if ((*a | 0x20) != (*b | 0x20))
+            return 0;
+    return *a == *b;
+}
+
+/* Returns -1 for an unknown key or value */
+static int x264vfw_settings_set(x264vfw_settings_t *settings, const char *key, const char *value)
+{
+    const x264vfw_setting_t *setting;
+    char *end;
+    long number;
+    int i;
+
+    for (setting = x264vfw_settings; setting->key; setting++)
+        if (x264vfw_name_equal(setting->key, key))
+            break;
+    if (!setting->key)
+        return -1;
+
+    for (i = 0; setting->names && setting->names[i]; i++)
+        if (x264vfw_name_equal(setting->names[i], value))
+        {
+            *SETTING_FIELD(settings, setting) = i;
+            return 0;
+        }
+
+    number = strtol(value, &end, 0);
+    if (end == value || *end || number < setting->min || number > setting->max)
+        return -1;
+    *SETTING_FIELD(settings, setting) = (int32_t)number;
+    return 0;
+}
+
+static char *x264vfw_trim(char *s)
+{
+    char *end;
+
+    while (*s == ' ' || *s == '\t')
+        s++;
+    end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+        end--;
+    *end = 0;
+    return s;
+}
+
+int x264vfw_settings_read_ini(x264vfw_settings_t *settings, const char *filename)
+{
+    char line[256];
+    int line_number = 0;
+    FILE *f;
+
+    if (!(f = fopen(filename, "r")))
+        return -1;
+    while (fgets(line, sizeof(line), f))
+    {
+        char *key = line;
+        char *value;
+
+        line_number++;
+        key[strcspn(key, ";#")] = 0;
+        if (!(value = strchr(key, '=')))
+            continue;
+        *value++ = 0;
+        key = x264vfw_trim(key);
+        value = x264vfw_trim(value);
+        if (x264vfw_settings_set(settings, key, value) < 0)
+            DPRINTF("%s:%d: ignored %s=%s\n", filename, line_number, key, value);
+    }
+    fclose(f);
+    return 0;
+}
+
+int x264vfw_settings_write_ini(const x264vfw_settings_t *settings, const char *filename)
+{
+    const x264vfw_setting_t *setting;
+    FILE *f;
+
+    if (!(f = fopen(filename, "w")))
+    {
+        DPRINTF("can't create %s\n", filename);
+        return -1;
+    }
+    fputs("; x265vfw settings, read by every opened driver.\n"
+          "; The environment variables X264VFW_<KEY> override them.\n"
+          "[x265vfw]\n", f);
+    for (setting = x264vfw_settings; setting->key; setting++)
+    {
+        int32_t value = *SETTING_FIELD(settings, setting);
+        int i;
+
+        if (setting->names)
+        {
+            fputs("; ", f);
+            for (i = 0; setting->names[i]; i++)
+                fprintf(f, i ? ", %s" : "%s", setting->names[i]);
+            fputc('\n', f);
+            fprintf(f, "%s=%s\n", setting->key, setting->names[value]);
+        }
+        else
+            fprintf(f, "%s=%d\n", setting->key, value);
+    }
+    return fclose(f) ? -1 : 0;
+}
+
+void x264vfw_settings_read_env(x264vfw_settings_t *settings)
+{
+    const x264vfw_setting_t *setting;
+    char name[64];
+
+    for (setting = x264vfw_settings; setting->key; setting++)
+    {
+        const char *value;
+        char *p;
+
+        snprintf(name, sizeof(name), "X264VFW_%s", setting->key);
+        for (p = name; *p; p++)
+            if (*p >= 'a' && *p <= 'z')
+                *p -= 'a' - 'A';
+        if ((value = getenv(name)) && *value && x264vfw_settings_set(settings, setting->key, value) < 0)
+            DPRINTF("ignored %s=%s\n", name, value);
+    }
+}
+
+int x264vfw_settings_from_blob(x264vfw_settings_t *settings, const void *blob, int size)
+{
+    x264vfw_settings_t in;
+    uint32_t used;
+
+    if (!blob || size < (int)offsetof(x264vfw_settings_t, mode))
+        return -1;
+    memcpy(&in, blob, offsetof(x264vfw_settings_t, mode));
+    if (in.version < 1 || in.size < offsetof(x264vfw_settings_t, mode) || in.size > (uint32_t)size)
+        return -1;
+
+    used = X264VFW_MIN(in.size, sizeof(x264vfw_settings_t));
+    memcpy(settings, blob, used);
+    x264vfw_settings_validate(settings);
+    return in.size;
+}
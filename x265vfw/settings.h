@@ -0,0 +1,62 @@
+/*****************************************************************************
+ * settings.h: runtime settings of a decoder instance
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_SETTINGS_H
+#define X264VFW_SETTINGS_H
+
+#include "common.h"
+
+#define X264VFW_SETTINGS_VERSION 3
+
+/* Also the state blob of ICM_GETSTATE/ICM_SETSTATE, fields are only ever appended. The
+ * defaults are the compile-time ones of x265vfw_config.h */
+typedef struct
+{
+    uint32_t version;          /* X264VFW_SETTINGS_VERSION */
+    uint32_t size;             /* sizeof(x264vfw_settings_t) */
+    int32_t  mode;             /* X264VFW_MODE_* */
+    int32_t  threads;          /* decoder threads, 0 - the share of the thread budget */
+    int32_t  convert_threads;  /* 0 - as many as the decoder has */
+    int32_t  quality;          /* X264VFW_QUALITY_* */
+    int32_t  output_csp;       /* proposed by ICM_DECOMPRESS_GET_FORMAT, 0 - the layout of the stream */
+    int32_t  cache_size;       /* MB, 0 - no cache */
+    int32_t  frame_pool;
+    int32_t  keyframe_only;
+    int32_t  tonemap;          /* HDR to SDR for the BGRA/BGR24 output, version 2 */
+    int32_t  tonemap_peak;     /* nits of the brightest light of PQ */
+    int32_t  resilient;        /* X264VFW_RESILIENT_*, version 3 */
+} x264vfw_settings_t;
+
+void x264vfw_settings_default(x264vfw_settings_t *settings);
+/* Clamp the fields into their ranges */
+void x264vfw_settings_validate(x264vfw_settings_t *settings);
+
+/* key=value lines, ';' and '#' start comments and sections are ignored. Unknown keys and
+ * values are skipped. Returns -1 if the file can't be read */
+int  x264vfw_settings_read_ini(x264vfw_settings_t *settings, const char *filename);
+int  x264vfw_settings_write_ini(const x264vfw_settings_t *settings, const char *filename);
+/* The keys in upper case with the X264VFW_ prefix, e.g. X264VFW_THREADS=4 */
+void x264vfw_settings_read_env(x264vfw_settings_t *settings);
+
+/* Blob of another version: the fields both versions know are taken, the others stay.
+ * Returns the bytes used or -1 if it isn't a settings blob */
+int  x264vfw_settings_from_blob(x264vfw_settings_t *settings, const void *blob, int size);
+
+#endif
@@ -0,0 +1,60 @@
+/*****************************************************************************
+ * stats.c: performance counters of a decoder instance
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "stats.h"
+
+void x264vfw_stats_add_time(x264vfw_stage_stats_t *stage, int64_t time)
+{
+    int i = 0;
+
+    while (i < X264VFW_STATS_BUCKETS - 1 && time >= (int64_t)1 << i)
+        i++;
+    stage->histogram[i]++;
+    stage->calls++;
+    stage->total += time;
+    if (time > stage->max)
+        stage->max = time;
+}
+
+static void x264vfw_stats_write_stage(FILE *f, const char *name, const x264vfw_stage_stats_t *stage)
+{
+    int i;
+
+    fprintf(f, ",\"%s\":{\"calls\":%u,\"total_us\":%lld,\"max_us\":%lld,\"histogram\":[",
+            name, stage->calls, (long long)stage->total, (long long)stage->max);
+    for (i = 0; i < X264VFW_STATS_BUCKETS; i++)
+        fprintf(f, i ? ",%u" : "%u", stage->histogram[i]);
+    fputs("]}", f);
+}
+
+void x264vfw_stats_write_json(FILE *f, const x264vfw_stats_t *stats, int64_t time)
+{
+    fprintf(f, "{\"time_us\":%lld,\"frames_in\":%u,\"frames_out\":%u,\"frames_hidden\":%u,\"frames_discard\":%u,"
+               "\"frames_nonkey\":%u,\"frames_black\":%u,\"bytes_in\":%llu,\"bytes_copied\":%llu,"
+               "\"sws_rebuilds\":%u,\"decoder_opens\":%u,\"decoder_restarts\":%u,\"frames_concealed\":%u",
+            (long long)time, stats->frames_in, stats->frames_out, stats->frames_hidden, stats->frames_discard,
+            stats->frames_nonkey, stats->frames_black, (unsigned long long)stats->bytes_in,
+            (unsigned long long)stats->bytes_copied, stats->sws_rebuilds, stats->decoder_opens, stats->decoder_restarts,
+            stats->frames_concealed);
+    x264vfw_stats_write_stage(f, "copy", &stats->copy);
+    x264vfw_stats_write_stage(f, "decode", &stats->decode);
+    x264vfw_stats_write_stage(f, "convert", &stats->convert);
+    fputs("}\n", f);
+}
@@ -0,0 +1,64 @@
+/*****************************************************************************
+ * stats.h: performance counters of a decoder instance
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_STATS_H
+#define X264VFW_STATS_H
+
+#include "common.h"
+
+/* Bucket 0 counts the calls under 1 us, bucket i those from 2^(i-1) up to 2^i us,
+ * the last one everything from 2^(X264VFW_STATS_BUCKETS-2) us (262 ms) up */
+#define X264VFW_STATS_BUCKETS 20
+
+/* Time spent in one stage of the pipeline */
+typedef struct
+{
+    uint32_t calls;
+    uint32_t reserved;
+    int64_t  total;       /* microseconds */
+    int64_t  max;
+    uint32_t histogram[X264VFW_STATS_BUCKETS];
+} x264vfw_stage_stats_t;
+
+/* Counted from DRV_OPEN on, the decoder may be opened and restarted many times in between */
+typedef struct
+{
+    uint32_t frames_in;         /* packets decoded */
+    uint32_t frames_out;        /* decoded pictures */
+    uint32_t frames_hidden;     /* X264VFW_DECODE_HIDDEN, not converted */
+    uint32_t frames_discard;    /* decoded with non-reference frames discarded */
+    uint32_t frames_nonkey;     /* skipped in the keyframe-only mode */
+    uint32_t frames_black;      /* black frames shown for the pictures which weren't there */
+    uint64_t bytes_in;
+    uint64_t bytes_copied;      /* into padded packets */
+    uint32_t sws_rebuilds;      /* swscale contexts created for a new geometry or source format */
+    uint32_t decoder_opens;
+    uint32_t decoder_restarts;  /* BEGINs which only flushed the decoder */
+    uint32_t frames_concealed;  /* shown as the last good picture while the resilient mode waited for an IRAP */
+    x264vfw_stage_stats_t copy; /* packet preparation and cache lookups */
+    x264vfw_stage_stats_t decode;
+    x264vfw_stage_stats_t convert;
+} x264vfw_stats_t;
+
+void x264vfw_stats_add_time(x264vfw_stage_stats_t *stage, int64_t time);
+/* Write the counters as one line of JSON, time is the timestamp of the line in microseconds */
+void x264vfw_stats_write_json(FILE *f, const x264vfw_stats_t *stats, int64_t time);
+
+#endif
@@ -0,0 +1,282 @@
+/*****************************************************************************
+ * thread.c: thread pool
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "thread.h"
+
+#ifdef _WIN32
+#include <process.h>
+#endif
+
+typedef struct x264vfw_batch_t
+{
+    void (*func)(void *, int);
+    void *arg;
+    int  jobs;
+    int  next;     /* next job to hand out */
+    int  pending;  /* jobs not finished yet */
+#ifdef _WIN32
+    HANDLE done;
+#endif
+    struct x264vfw_batch_t *link;
+} x264vfw_batch_t;
+
+struct x264vfw_threadpool_t
+{
+    x264vfw_mutex_t  mutex;
+#ifdef _WIN32
+    HANDLE           wakeup;   /* semaphore */
+#else
+    pthread_cond_t   wakeup;
+    pthread_cond_t   done;     /* some batch has finished */
+#endif
+    x264vfw_batch_t  *head;    /* batches which still have jobs to hand out */
+    x264vfw_batch_t  *tail;
+    int              exit;
+    int              threads;
+#ifdef _WIN32
+    HANDLE           thread[X264VFW_THREAD_MAX];
+#else
+    pthread_t        thread[X264VFW_THREAD_MAX];
+#endif
+};
+
+/* Must be called with the mutex held */
+static void threadpool_unlink(x264vfw_threadpool_t *pool, x264vfw_batch_t *batch)
+{
+    x264vfw_batch_t **p = &pool->head;
+    x264vfw_batch_t *prev = NULL;
+
+    while (*p && *p != batch)
+    {
+        prev = *p;
+        p = &prev->link;
+    }
+    if (!*p)
+        return;
+    *p = batch->link;
+    if (pool->tail == batch)
+        pool->tail = prev;
+}
+
+/* Hand out the next job of the batch (or of the oldest queued batch if NULL).
+ * Must be called with the mutex held */
+static x264vfw_batch_t *threadpool_claim(x264vfw_threadpool_t *pool, x264vfw_batch_t *batch, int *job)
+{
+    if (!batch)
+        batch = pool->head;
+    if (!batch || batch->next >= batch->jobs)
+        return NULL;
+    *job = batch->next++;
+    /* Fully handed out, nobody should look at it anymore */
+    if (batch->next == batch->jobs)
+        threadpool_unlink(pool, batch);
+    return batch;
+}
+
+/* Must be called with the mutex held */
+static void threadpool_finish(x264vfw_threadpool_t *pool, x264vfw_batch_t *batch)
+{
+    if (--batch->pending == 0)
+#ifdef _WIN32
+        SetEvent(batch->done);
+#else
+        pthread_cond_broadcast(&pool->done);
+#endif
+}
+
+#ifdef _WIN32
+static unsigned __stdcall threadpool_thread(void *arg)
+#else
+static void *threadpool_thread(void *arg)
+#endif
+{
+    x264vfw_threadpool_t *pool = arg;
+
+    for (;;)
+    {
+        x264vfw_batch_t *batch;
+        int job;
+
+#ifdef _WIN32
+        WaitForSingleObject(pool->wakeup, INFINITE);
+        x264vfw_mutex_lock(&pool->mutex);
+#else
+        x264vfw_mutex_lock(&pool->mutex);
+        while (!pool->exit && !pool->head)
+            pthread_cond_wait(&pool->wakeup, &pool->mutex);
+#endif
+        if (pool->exit)
+        {
+            x264vfw_mutex_unlock(&pool->mutex);
+            break;
+        }
+        while ((batch = threadpool_claim(pool, NULL, &job)))
+        {
+            x264vfw_mutex_unlock(&pool->mutex);
+            batch->func(batch->arg, job);
+            x264vfw_mutex_lock(&pool->mutex);
+            threadpool_finish(pool, batch);
+        }
+        x264vfw_mutex_unlock(&pool->mutex);
+    }
+    return 0;
+}
+
+int x264vfw_threadpool_init(x264vfw_threadpool_t **p_pool, int threads)
+{
+    x264vfw_threadpool_t *pool;
+    int i;
+
+    *p_pool = NULL;
+    threads = X264VFW_MIN(threads, X264VFW_THREAD_MAX);
+    if (threads <= 0)
+        return -1;
+
+    pool = calloc(1, sizeof(x264vfw_threadpool_t));
+    if (!pool)
+        return -1;
+    x264vfw_mutex_init(&pool->mutex);
+#ifdef _WIN32
+    pool->wakeup = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+    if (!pool->wakeup)
+    {
+        x264vfw_mutex_destroy(&pool->mutex);
+        free(pool);
+        return -1;
+    }
+#else
+    pthread_cond_init(&pool->wakeup, NULL);
+    pthread_cond_init(&pool->done, NULL);
+#endif
+
+    for (i = 0; i < threads; i++)
+    {
+#ifdef _WIN32
+        pool->thread[i] = (HANDLE)_beginthreadex(NULL, 0, threadpool_thread, pool, 0, NULL);
+        if (!pool->thread[i])
+            break;
+#else
+        if (pthread_create(&pool->thread[i], NULL, threadpool_thread, pool))
+            break;
+#endif
+        pool->threads++;
+    }
+    if (!pool->threads)
+    {
+        x264vfw_threadpool_delete(pool);
+        return -1;
+    }
+
+    *p_pool = pool;
+    return 0;
+}
+
+void x264vfw_threadpool_run(x264vfw_threadpool_t *pool, void (*func)(void *, int), void *arg, int jobs)
+{
+    x264vfw_batch_t batch;
+    int job;
+#ifdef _WIN32
+    int pending;
+#endif
+
+#ifdef _WIN32
+    if (!pool || jobs <= 1 || !(batch.done = CreateEvent(NULL, TRUE, FALSE, NULL)))
+#else
+    if (!pool || jobs <= 1)
+#endif
+    {
+        for (job = 0; job < jobs; job++)
+            func(arg, job);
+        return;
+    }
+
+    batch.func = func;
+    batch.arg = arg;
+    batch.jobs = jobs;
+    batch.next = 0;
+    batch.pending = jobs;
+    batch.link = NULL;
+
+    x264vfw_mutex_lock(&pool->mutex);
+    if (pool->tail)
+        pool->tail->link = &batch;
+    else
+        pool->head = &batch;
+    pool->tail = &batch;
+#ifdef _WIN32
+    x264vfw_mutex_unlock(&pool->mutex);
+    ReleaseSemaphore(pool->wakeup, X264VFW_MIN(jobs - 1, pool->threads), NULL);
+    x264vfw_mutex_lock(&pool->mutex);
+#else
+    for (job = 0; job < X264VFW_MIN(jobs - 1, pool->threads); job++)
+        pthread_cond_signal(&pool->wakeup);
+#endif
+
+    /* Help with our own batch */
+    while (threadpool_claim(pool, &batch, &job))
+    {
+        x264vfw_mutex_unlock(&pool->mutex);
+        func(arg, job);
+        x264vfw_mutex_lock(&pool->mutex);
+        threadpool_finish(pool, &batch);
+    }
+#ifdef _WIN32
+    pending = batch.pending;
+    x264vfw_mutex_unlock(&pool->mutex);
+
+    /* The event is set under the mutex so it is safe to destroy the batch afterwards */
+    if (pending)
+        WaitForSingleObject(batch.done, INFINITE);
+    CloseHandle(batch.done);
+#else
+    while (batch.pending)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    x264vfw_mutex_unlock(&pool->mutex);
+#endif
+}
+
+void x264vfw_threadpool_delete(x264vfw_threadpool_t *pool)
+{
+    int i;
+
+    if (!pool)
+        return;
+
+    x264vfw_mutex_lock(&pool->mutex);
+    pool->exit = 1;
+    x264vfw_mutex_unlock(&pool->mutex);
+#ifdef _WIN32
+    ReleaseSemaphore(pool->wakeup, pool->threads, NULL);
+    for (i = 0; i < pool->threads; i++)
+    {
+        WaitForSingleObject(pool->thread[i], INFINITE);
+        CloseHandle(pool->thread[i]);
+    }
+    CloseHandle(pool->wakeup);
+#else
+    pthread_cond_broadcast(&pool->wakeup);
+    for (i = 0; i < pool->threads; i++)
+        pthread_join(pool->thread[i], NULL);
+    pthread_cond_destroy(&pool->wakeup);
+    pthread_cond_destroy(&pool->done);
+#endif
+    x264vfw_mutex_destroy(&pool->mutex);
+    free(pool);
+}
@@ -0,0 +1,37 @@
+/*****************************************************************************
+ * thread.h: thread pool
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_THREAD_H
+#define X264VFW_THREAD_H
+
+#include "common.h"
+
+#define X264VFW_THREAD_MAX 64
+
+typedef struct x264vfw_threadpool_t x264vfw_threadpool_t;
+
+/* Create a pool with the given number of worker threads. Returns 0 on success */
+int  x264vfw_threadpool_init(x264vfw_threadpool_t **p_pool, int threads);
+/* Run func(arg, job) for job in [0, jobs) and wait for all of them to finish.
+ * The calling thread takes part in the work and several threads may run batches concurrently */
+void x264vfw_threadpool_run(x264vfw_threadpool_t *pool, void (*func)(void *, int), void *arg, int jobs);
+void x264vfw_threadpool_delete(x264vfw_threadpool_t *pool);
+
+#endif
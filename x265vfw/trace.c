@@ -0,0 +1,161 @@
+/*****************************************************************************
+ * trace.c: recorded decompression sessions
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#include "trace.h"
+
+struct x264vfw_trace_t
+{
+    FILE     *file;
+    int      writing;
+    int      failed;
+    int64_t  start;     /* x264vfw_mdate of the creation */
+    uint8_t  *data;     /* payload of the last record read */
+    uint32_t data_size;
+};
+
+int x264vfw_trace_create(x264vfw_trace_t **p_trace, const char *filename)
+{
+    x264vfw_trace_t *trace;
+    uint32_t version = X264VFW_TRACE_VERSION;
+
+    *p_trace = NULL;
+    if (!(trace = malloc(sizeof(x264vfw_trace_t))))
+        return -1;
+    memset(trace, 0, sizeof(x264vfw_trace_t));
+
+    if (!(trace->file = fopen(filename, "wb")))
+    {
+        DPRINTF("can't create the trace %s\n", filename);
+        free(trace);
+        return -1;
+    }
+    if (fwrite(X264VFW_TRACE_MAGIC, 8, 1, trace->file) != 1 ||
+        fwrite(&version, sizeof(version), 1, trace->file) != 1)
+    {
+        DPRINTF("can't write the trace %s\n", filename);
+        fclose(trace->file);
+        free(trace);
+        return -1;
+    }
+    trace->writing = 1;
+    trace->start = x264vfw_mdate();
+    *p_trace = trace;
+    return 0;
+}
+
+int x264vfw_trace_open(x264vfw_trace_t **p_trace, const char *filename)
+{
+    x264vfw_trace_t *trace;
+    char magic[8];
+    uint32_t version;
+
+    *p_trace = NULL;
+    if (!(trace = malloc(sizeof(x264vfw_trace_t))))
+        return -1;
+    memset(trace, 0, sizeof(x264vfw_trace_t));
+
+    if (!(trace->file = fopen(filename, "rb")))
+    {
+        free(trace);
+        return -1;
+    }
+    if (fread(magic, sizeof(magic), 1, trace->file) != 1 || memcmp(magic, X264VFW_TRACE_MAGIC, 8) ||
+        fread(&version, sizeof(version), 1, trace->file) != 1 || version < 1 || version > X264VFW_TRACE_VERSION)
+    {
+        DPRINTF("%s is not a trace of version 1 to %d\n", filename, X264VFW_TRACE_VERSION);
+        fclose(trace->file);
+        free(trace);
+        return -1;
+    }
+    *p_trace = trace;
+    return 0;
+}
+
+int64_t x264vfw_trace_time(x264vfw_trace_t *trace)
+{
+    return x264vfw_mdate() - trace->start;
+}
+
+void x264vfw_trace_write(x264vfw_trace_t *trace, uint32_t type, int32_t result, int64_t start, int64_t end,
+                         const void *data1, uint32_t size1, const void *data2, uint32_t size2,
+                         const void *data3, uint32_t size3)
+{
+    x264vfw_trace_record_t record;
+
+    if (!trace->writing || trace->failed)
+        return;
+
+    if (!data1)
+        size1 = 0;
+    if (!data2)
+        size2 = 0;
+    if (!data3)
+        size3 = 0;
+
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.result = result;
+    record.time = start;
+    record.duration = end - start;
+    record.size = size1 + size2 + size3;
+
+    if (fwrite(&record, sizeof(record), 1, trace->file) != 1 ||
+        (size1 && fwrite(data1, size1, 1, trace->file) != 1) ||
+        (size2 && fwrite(data2, size2, 1, trace->file) != 1) ||
+        (size3 && fwrite(data3, size3, 1, trace->file) != 1))
+    {
+        /* Most likely the disk is full, a truncated trace is still usable up to here */
+        DPRINTF("trace write failed, recording stopped\n");
+        trace->failed = 1;
+    }
+}
+
+int x264vfw_trace_read(x264vfw_trace_t *trace, x264vfw_trace_record_t *record, uint8_t **data)
+{
+    if (trace->writing)
+        return -1;
+
+    if (fread(record, sizeof(x264vfw_trace_record_t), 1, trace->file) != 1)
+        return feof(trace->file) ? 0 : -1;
+
+    if (record->size > trace->data_size)
+    {
+        uint8_t *tmp = realloc(trace->data, record->size);
+        if (!tmp)
+            return -1;
+        trace->data = tmp;
+        trace->data_size = record->size;
+    }
+    /* The recording may have been cut in the middle of a record */
+    if (record->size && fread(trace->data, record->size, 1, trace->file) != 1)
+        return 0;
+
+    *data = trace->data;
+    return 1;
+}
+
+void x264vfw_trace_close(x264vfw_trace_t *trace)
+{
+    if (!trace)
+        return;
+    fclose(trace->file);
+    free(trace->data);
+    free(trace);
+}
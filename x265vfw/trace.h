@@ -0,0 +1,86 @@
+/*****************************************************************************
+ * trace.h: recorded decompression sessions
+ *****************************************************************************
+ * Copyright (C) 2016 x265vfw project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+#ifndef X264VFW_TRACE_H
+#define X264VFW_TRACE_H
+
+#include "common.h"
+
+/* The file starts with the magic and the version (uint32_t), then come the records.
+ * Everything is little-endian, as the driver writes it on x86. Version 1 had no settings */
+#define X264VFW_TRACE_MAGIC   "x265vfwT"
+#define X264VFW_TRACE_VERSION 2
+
+/* Record types, one per ICM_DECOMPRESS* message */
+#define X264VFW_TRACE_GET_FORMAT    1 /* payload: the input BITMAPINFOHEADER and extradata */
+#define X264VFW_TRACE_QUERY         2 /* payload: the input BITMAPINFOHEADER and extradata */
+#define X264VFW_TRACE_BEGIN         3 /* payload: x264vfw_trace_begin_t, the settings, the input and the output headers */
+#define X264VFW_TRACE_FRAME         4 /* payload: x264vfw_trace_frame_t and the compressed frame */
+#define X264VFW_TRACE_END           5 /* no payload */
+/* ICM_X264VFW_SET_KEYFRAME_ONLY and ICM_SETSTATE, which change keyframe_only at once */
+#define X264VFW_TRACE_KEYFRAME_ONLY 6 /* payload: int32_t, keyframe_only after the call */
+
+typedef struct
+{
+    uint32_t type;
+    int32_t  result;    /* returned to the host, 0 (ICERR_OK) on success */
+    int64_t  time;      /* start of the call, microseconds since the trace was opened */
+    int64_t  duration;  /* microseconds spent in the call */
+    uint32_t size;      /* payload bytes which follow */
+    uint32_t reserved;
+} x264vfw_trace_record_t;
+
+typedef struct
+{
+    int32_t  csp;       /* X264VFW_CSP_* of the output header */
+    uint32_t in_size;   /* BITMAPINFOHEADER and extradata */
+    uint32_t out_size;
+    uint32_t settings_size; /* x264vfw_settings_t of the driver (0 in version 1), keyframe_only as it was at the call */
+} x264vfw_trace_begin_t;
+
+typedef struct
+{
+    int32_t  flags;     /* X264VFW_DECODE_* */
+    uint32_t vfw_flags; /* ICDECOMPRESS_* as the host sent them */
+    int32_t  width;     /* of the output bitmap */
+    int32_t  height;
+    int32_t  src[4];    /* x, y, width, height */
+    int32_t  dst[4];    /* empty if the host's rectangles were rejected */
+} x264vfw_trace_frame_t;
+
+typedef struct x264vfw_trace_t x264vfw_trace_t;
+
+/* Create a trace file. Returns 0 on success */
+int  x264vfw_trace_create(x264vfw_trace_t **p_trace, const char *filename);
+/* Open a trace file for reading. Returns 0 on success */
+int  x264vfw_trace_open(x264vfw_trace_t **p_trace, const char *filename);
+/* Microseconds since the trace was created, the time base of the records */
+int64_t x264vfw_trace_time(x264vfw_trace_t *trace);
+/* Write one record, the payload is given in up to three parts (NULL parts are skipped).
+ * A failed write stops the recording */
+void x264vfw_trace_write(x264vfw_trace_t *trace, uint32_t type, int32_t result, int64_t start, int64_t end,
+                         const void *data1, uint32_t size1, const void *data2, uint32_t size2,
+                         const void *data3, uint32_t size3);
+/* Read the next record, *data points to its payload until the next read.
+ * Returns 1 for a record, 0 at the end of the trace and -1 on error */
+int  x264vfw_trace_read(x264vfw_trace_t *trace, x264vfw_trace_record_t *record, uint8_t **data);
+void x264vfw_trace_close(x264vfw_trace_t *trace);
+
+#endif
@@ -28,10 +28,7 @@
 #include "common.h"
 #include <vfw.h>
 
-#include <libavcodec/avcodec.h>
-#include <libswscale/swscale.h>
-
-#include "csp.h"
+#include "decoder.h"
 
 /* Name */
 #define X264VFW_NAME_L L"x265vfw"
@@ -55,9 +52,24 @@
 #define FOURCC_YUY2 mmioFOURCC('Y','U','Y','2')
 #define FOURCC_UYVY mmioFOURCC('U','Y','V','Y')
 #define FOURCC_HDYC mmioFOURCC('H','D','Y','C')
+/* YUV 4:2:0 16-bit, with one Y plane and one packed U+V */
+#define FOURCC_P010 mmioFOURCC('P','0','1','0')
+#define FOURCC_P016 mmioFOURCC('P','0','1','6')
+/* YUV 4:2:2 10-bit packed */
+#define FOURCC_V210 mmioFOURCC('v','2','1','0')
+/* YUV 4:4:4 10/16-bit packed */
+#define FOURCC_Y410 mmioFOURCC('Y','4','1','0')
+#define FOURCC_Y416 mmioFOURCC('Y','4','1','6')
 
 #define COUNT_FOURCC     7
 
+/* Private driver messages */
+#define ICM_X264VFW_GET_DELAY         (ICM_USER + 0x0100) /* returns the decoder output delay in frames */
+#define ICM_X264VFW_SET_KEYFRAME_ONLY (ICM_USER + 0x0101) /* lParam1: decode only the IRAP pictures */
+#define ICM_X264VFW_GET_CACHE_STATS   (ICM_USER + 0x0102) /* lParam1: x264vfw_cache_stats_t *, lParam2: its size */
+#define ICM_X264VFW_GET_STATS         (ICM_USER + 0x0103) /* lParam1: x264vfw_stats_t *, lParam2: its size */
+#define ICM_X264VFW_FLUSH_EVENTS      (ICM_USER + 0x0104) /* write the event trace now, see X264VFW_EVENTS_ENV */
+
 /* Types */
 typedef struct
 {
@@ -65,33 +77,22 @@ typedef struct
     const DWORD value;
 } named_fourcc_t;
 
-/* CODEC: VFW codec instance */
-typedef struct
-{
-    /* Decoder */
-    int                decoder_is_avc;
-    AVCodec            *decoder;
-    AVCodecContext     *decoder_context;
-    AVFrame            *decoder_frame;
-    void               *decoder_extradata;
-    void               *decoder_buf;
-    DWORD              decoder_buf_size;
-    AVPacket           decoder_pkt;
-    enum AVPixelFormat decoder_pix_fmt;
-    int                decoder_vflip;
-    int                decoder_swap_UV;
-    struct SwsContext  *sws;
-} CODEC;
-
 /* Decompress functions */
 LRESULT x264vfw_decompress_get_format(CODEC *, BITMAPINFO *, BITMAPINFO *);
 LRESULT x264vfw_decompress_query(CODEC *, BITMAPINFO *, BITMAPINFO *);
+LRESULT x264vfw_decompress_query_ex(CODEC *, ICDECOMPRESSEX *);
 LRESULT x264vfw_decompress_begin(CODEC *, BITMAPINFO *, BITMAPINFO *);
+LRESULT x264vfw_decompress_begin_ex(CODEC *, ICDECOMPRESSEX *);
 LRESULT x264vfw_decompress(CODEC *, ICDECOMPRESS *);
 LRESULT x264vfw_decompress_ex(CODEC *, ICDECOMPRESSEX *);
 LRESULT x264vfw_decompress_end(CODEC *);
-
-/* DLL critical section */
-extern CRITICAL_SECTION x264vfw_CS;
+void    x264vfw_decompress_close(CODEC *);
+void    x264vfw_decompress_record(CODEC *, UINT, LPARAM, LPARAM, LRESULT, int64_t, int64_t);
+LRESULT x264vfw_decompress_get_delay(CODEC *);
+LRESULT x264vfw_decompress_set_keyframe_only(CODEC *, int);
+LRESULT x264vfw_decompress_get_state(CODEC *, void *, DWORD);
+LRESULT x264vfw_decompress_set_state(CODEC *, const void *, DWORD);
+LRESULT x264vfw_decompress_get_cache_stats(CODEC *, x264vfw_cache_stats_t *, DWORD);
+LRESULT x264vfw_decompress_get_stats(CODEC *, x264vfw_stats_t *, DWORD);
 
 #endif
@@ -4,4 +4,77 @@
 #define X264VFW_USE_VIRTUALDUB_HACK 1
 #define X264VFW_DEBUG_OUTPUT        0
 
+/* Decoder threading modes */
+#define X264VFW_MODE_LATENCY        0 /* slice (WPP) threads only, no additional output delay */
+#define X264VFW_MODE_THROUGHPUT     1 /* frame threads, the output is delayed by several frames */
+#define X264VFW_DECODER_MODE        X264VFW_MODE_LATENCY
+
+/* Threads shared by all the decoders of the process (0 - one per CPU) */
+#define X264VFW_THREAD_BUDGET       0
+
+/* Decode only the keyframes and repeat them for the other frames (thumbnails, scanning) */
+#define X264VFW_KEYFRAME_ONLY       0
+
+/* Live streams with lost packets: after a decoding error or a corrupt picture nothing is decoded until the
+ * next IRAP picture, the last good picture is shown meanwhile */
+#define X264VFW_RESILIENT_OFF       0
+#define X264VFW_RESILIENT_UNTOUCHED 1 /* the output buffer is left as it is, for hosts which reuse it */
+#define X264VFW_RESILIENT_COPY      2 /* the last good picture is kept and copied into the output */
+#define X264VFW_RESILIENT           X264VFW_RESILIENT_OFF
+
+/* Decode into frame buffers owned by the driver and reused, not allocated per frame */
+#define X264VFW_FRAME_POOL          1
+
+/* Quality of the swscale conversions (stretching and the layouts without a direct path) */
+#define X264VFW_QUALITY_FAST        0 /* bilinear, no accurate rounding */
+#define X264VFW_QUALITY_NORMAL      1 /* bilinear, accurate rounding */
+#define X264VFW_QUALITY_HIGH        2 /* bicubic, full chroma input, accurate rounding */
+#define X264VFW_CONVERT_QUALITY     X264VFW_QUALITY_HIGH
+
+/* Output format proposed by ICM_DECOMPRESS_GET_FORMAT (X264VFW_CSP_*, 0 - the 8-bit layout of the stream),
+ * e.g. X264VFW_CSP_P010 for the hosts which take 10-bit output but only ask for the proposed format */
+#define X264VFW_OUTPUT_CSP          0
+
+/* Tone map PQ (SMPTE ST 2084) and HLG (ARIB STD-B67) streams to SDR BT.709 for the BGRA/BGR24 output
+ * (1:1 only, stretching goes through swscale untouched) */
+#define X264VFW_TONEMAP             1
+/* Brightest light of the PQ streams in nits, mapped to the SDR peak (HLG has a nominal 1000 nits) */
+#define X264VFW_TONEMAP_PEAK        1000
+/* HDR reference white in nits (BT.2408), the unit of the tone curve */
+#define X264VFW_TONEMAP_WHITE       203
+
+/* Memory for the cache of converted pictures in MB (0 - disabled) */
+#define X264VFW_CACHE_SIZE          0
+/* Packets skipped by cache hits which may wait to be decoded */
+#define X264VFW_CACHE_MAX_PENDING   64
+
+/* Colorspace conversion threads (0 - the share of the thread budget) */
+#define X264VFW_CONVERT_THREADS     0
+/* Minimal height of one band for the threaded conversion */
+#define X264VFW_CONVERT_BAND_HEIGHT 128
+
+/* Settings file read at every DRV_OPEN and written by DRV_CONFIGURE: the path in the X264VFW_INI_ENV
+ * environment variable, else X264VFW_INI_NAME in %APPDATA%. Environment variables X264VFW_<KEY>
+ * (e.g. X264VFW_THREADS) override its keys, ICM_SETSTATE overrides both */
+#define X264VFW_INI_ENV             "X264VFW_INI"
+#define X264VFW_INI_NAME            "x265vfw.ini"
+
+/* Environment variable with the path prefix of the recorded decompression sessions (unset - no recording),
+ * every opened driver writes <prefix>-<process id>-<instance>.trace for x265vfw_replay */
+#define X264VFW_RECORD_ENV          "X264VFW_RECORD"
+
+/* Environment variable with the path prefix of the periodic stats dumps (unset - no dumps),
+ * every opened driver appends one line of JSON to <prefix>-<process id>-<instance>.json */
+#define X264VFW_STATS_ENV           "X264VFW_STATS"
+/* Milliseconds between two dumps */
+#define X264VFW_STATS_INTERVAL      1000
+
+/* Runtime event trace of the pipeline (0 - not compiled in) */
+#define X264VFW_EVENTS              1
+/* Environment variable with the path prefix of the event traces (unset - off), every opened driver
+ * writes the last X264VFW_EVENTS_SIZE events to <prefix>-<process id>-<instance>.events.json at
+ * DRV_CLOSE and ICM_X264VFW_FLUSH_EVENTS, in the Chrome trace format (chrome://tracing) */
+#define X264VFW_EVENTS_ENV          "X264VFW_EVENTS"
+#define X264VFW_EVENTS_SIZE         65536
+
 #endif